@@ -0,0 +1,7 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+// Just enough of FreeRTOS.h for the host tests (see HostTests/README.md)
+#define portBASE_TYPE long
+#define pdTRUE 1
+#define pdFALSE 0
+#endif
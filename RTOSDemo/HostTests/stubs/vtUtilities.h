@@ -0,0 +1,8 @@
+#ifndef HOST_VT_UTILITIES_H
+#define HOST_VT_UTILITIES_H
+#include <stddef.h>
+// Just enough of vtUtilities.h for the host tests (see HostTests/README.md) -- there is only one thread, so a barrier
+//   only calls the hook (if the test has set one), which lets a test run the writer in the middle of a read
+extern void (*hostBarrierHook)(void);
+#define __DMB() do { if (hostBarrierHook != NULL) hostBarrierHook(); } while (0)
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "vtUtilities.h"
+#include "voltStats.h"
+
+// Checks the sliding window of voltStats.c against a brute force min/max/mean over the same values, the tumbling
+//   window against min/max/mean/variance/rms worked out in double precision, and the snapshot double buffer
+
+static vtStats stats;
+static uint8_t values[8192];
+static int failures = 0;
+
+void (*hostBarrierHook)(void) = NULL;
+
+// Feed len values, one call each, and compare the sliding snapshot after every one
+static void check(const char *name,uint16_t slideLen,int len)
+{
+	vtStatsSnap snap;
+	int i, k, first;
+	uint32_t n;
+	uint8_t lo, hi;
+	uint32_t sum;
+
+	if (vtStatsInit(&stats,slideLen,1000) != pdTRUE) {
+		printf("%s: vtStatsInit(%u) failed\n",name,slideLen);
+		failures++;
+		return;
+	}
+	for (i=0;i<len;i++) {
+		vtStatsBlock(&stats,&(values[i]),1,i);
+		vtStatsGetSliding(&stats,&snap);
+		first = (i+1 > slideLen) ? i+1-slideLen : 0;
+		n = i+1-first;
+		lo = 255; hi = 0; sum = 0;
+		for (k=first;k<=i;k++) {
+			if (values[k] < lo) lo = values[k];
+			if (values[k] > hi) hi = values[k];
+			sum += values[k];
+		}
+		if ((snap.count != n) || (snap.min != lo) || (snap.max != hi) || (snap.mean != (sum << 8) / n)) {
+			printf("%s: slideLen %u, after value %d: count %u min %u max %u mean %u, expected %d %u %u %u\n",name,slideLen,i,
+				(unsigned int) snap.count,snap.min,snap.max,snap.mean,n,lo,hi,(unsigned int) ((sum << 8) / n));
+			failures++;
+			return;
+		}
+	}
+}
+
+// Whether a result in 1/256ths is within tol of the exact value
+static int near(uint32_t got,double want,double tol)
+{
+	return(fabs((double) got - want*256.0) <= tol);
+}
+
+// Feed len values in blocks of 1 to 8, and compare the tumbling snapshot at the end of every window
+static void checkTumble(const char *name,uint16_t tumbleLen,int len)
+{
+	vtStatsSnap snap, prev;
+	int i, k, first, block;
+	uint32_t windows = 0;
+	uint8_t lo, hi;
+	double mean, var, ms;
+
+	if (vtStatsInit(&stats,1,tumbleLen) != pdTRUE) {
+		printf("%s: vtStatsInit(%u) failed\n",name,tumbleLen);
+		failures++;
+		return;
+	}
+	vtStatsGetTumbling(&stats,&snap);
+	if ((snap.count != 0) || (snap.windows != 0)) {
+		printf("%s: tumbleLen %u, snapshot before the first window is not empty\n",name,tumbleLen);
+		failures++;
+		return;
+	}
+	memset(&prev,0,sizeof(prev));
+	for (i=0;i<len;i+=block) {
+		block = 1 + (rand() % 8);
+		if (i+block > len) block = len-i;
+		vtStatsBlock(&stats,&(values[i]),block,i);
+		if ((uint32_t) ((i+block)/tumbleLen) == windows) continue;
+		// a window finished in this block (blocks are never longer than a window here unless tumbleLen is below 8,
+		//   and then only the latest one is looked at)
+		windows = (i+block)/tumbleLen;
+		vtStatsGetTumbling(&stats,&snap);
+		first = (windows-1)*tumbleLen;
+		lo = 255; hi = 0; mean = 0; ms = 0;
+		for (k=first;k<first+tumbleLen;k++) {
+			if (values[k] < lo) lo = values[k];
+			if (values[k] > hi) hi = values[k];
+			mean += values[k];
+			ms += (double) values[k] * values[k];
+		}
+		mean /= tumbleLen;
+		ms /= tumbleLen;
+		var = ms - mean*mean;
+		// mean and var are within 1/256th (var also relative to its size, as it comes from a running sum), and rms too,
+		//   apart from the integer square root rounding down
+		if ((snap.count != tumbleLen) || (snap.windows != windows) || (snap.stamp != (uint32_t) i) || (snap.min != lo) ||
+			(snap.max != hi) || (snap.p2p != hi-lo) || !near(snap.mean,mean,1.0) || !near(snap.var,var,1.0 + var*0.0001) ||
+			!near(snap.rms,sqrt(ms),1.5)) {
+			printf("%s: tumbleLen %u, window %u: count %u min %u max %u mean %u var %u rms %u, expected %u %u %u %.1f %.1f %.1f\n",
+				name,tumbleLen,(unsigned int) windows,(unsigned int) snap.count,snap.min,snap.max,snap.mean,(unsigned int) snap.var,
+				snap.rms,tumbleLen,lo,hi,mean*256.0,var*256.0,sqrt(ms)*256.0);
+			failures++;
+			return;
+		}
+		// each window is published once, into the copy that was not the latest, and the one before is left alone
+		if ((stats.tumble.seq != windows) || (memcmp(&(stats.tumble.copy[stats.tumble.seq & 1]),&snap,sizeof(snap)) != 0) ||
+			((windows > 1) && (tumbleLen >= 8) && (memcmp(&(stats.tumble.copy[(stats.tumble.seq - 1) & 1]),&prev,sizeof(prev)) != 0))) {
+			printf("%s: tumbleLen %u, window %u: seq %u or the copies are not as published\n",name,tumbleLen,
+				(unsigned int) windows,(unsigned int) stats.tumble.seq);
+			failures++;
+			return;
+		}
+		prev = snap;
+	}
+}
+
+// The writer, run from the barrier in the middle of a read: finishes one more tumbling window
+static uint8_t writerValues[64];
+static uint16_t writerLen;
+static void writerInRead(void)
+{
+	// only once, and not again from the barriers of the writer itself
+	hostBarrierHook = NULL;
+	vtStatsBlock(&stats,writerValues,writerLen,777);
+}
+
+// A reader that is preempted by the writer must not come away with the snapshot it started on
+static void checkTorn(void)
+{
+	vtStatsSnap snap;
+	int i;
+
+	writerLen = 16;
+	vtStatsInit(&stats,4,writerLen);
+	for (i=0;i<writerLen;i++) writerValues[i] = 10;
+	vtStatsBlock(&stats,writerValues,writerLen,1);
+	for (i=0;i<writerLen;i++) writerValues[i] = 200;
+	hostBarrierHook = writerInRead;
+	vtStatsGetTumbling(&stats,&snap);
+	if ((hostBarrierHook != NULL) || (snap.windows != 2) || (snap.min != 200) || (snap.stamp != 777)) {
+		printf("torn read: windows %u min %u stamp %u, expected 2 200 777\n",(unsigned int) snap.windows,snap.min,
+			(unsigned int) snap.stamp);
+		failures++;
+	}
+	hostBarrierHook = NULL;
+}
+
+int main(void)
+{
+	uint16_t lens[] = {1,2,7,127,vtStatsMaxSlide};
+	uint16_t tumbleLens[] = {1,3,8,100,1000,2048};
+	unsigned int i, j;
+
+	for (j=0;j<sizeof(lens)/sizeof(lens[0]);j++) {
+		// Monotonic runs much longer than the window fill the queues right up
+		for (i=0;i<1000;i++) values[i] = 255 - (i % 256);
+		check("decreasing",lens[j],1000);
+		for (i=0;i<1000;i++) values[i] = i % 256;
+		check("increasing",lens[j],1000);
+		for (i=0;i<1000;i++) values[i] = 100;
+		check("constant",lens[j],1000);
+		srand(lens[j]);
+		for (i=0;i<4096;i++) values[i] = rand() & 0xFF;
+		check("random",lens[j],4096);
+	}
+	for (j=0;j<sizeof(tumbleLens)/sizeof(tumbleLens[0]);j++) {
+		srand(tumbleLens[j]);
+		for (i=0;i<8192;i++) values[i] = rand() & 0xFF;
+		checkTumble("random",tumbleLens[j],8192);
+		// a narrow spread far from 0, where a mean that drifts shows up most in the variance
+		for (i=0;i<8192;i++) values[i] = 200 + (rand() % 5);
+		checkTumble("narrow",tumbleLens[j],8192);
+		for (i=0;i<8192;i++) values[i] = (i & 1) ? 255 : 0;
+		checkTumble("alternating",tumbleLens[j],8192);
+		for (i=0;i<8192;i++) values[i] = i % 256;
+		checkTumble("ramp",tumbleLens[j],8192);
+	}
+	checkTorn();
+	if (failures != 0) return(1);
+	printf("voltStats: all passed\n");
+	return(0);
+}
@@ -10,4 +10,7 @@
 #define vtI2CMsgTypeVoltInit 1
 #define vtI2CMsgTypeVoltRead 2
 #define VoltMsgTypeTimer 3
+#define VoltMsgTypeADC 4
+#define vtI2CMsgTypeSensorInit 5
+#define vtI2CMsgTypeSensorRead 6
 #endif
\ No newline at end of file
@@ -33,12 +33,20 @@
 #define LCDMsgTypePrint 2
 // a value to graph
 #define LCDMsgTypeGraph 3
+// a block of values to graph
+#define LCDMsgTypeGraphBlock 4
+// room needed in a message for the longest string or block of values
+#if vtLCDMaxLen > (8*vtLCDMaxBlock)
+#define vtLCDBufLen vtLCDMaxLen
+#else
+#define vtLCDBufLen (8*vtLCDMaxBlock)
+#endif
 
 // actual data structure that is sent in a message
 typedef struct __vtLCDMsg {
 	uint8_t msgType;
 	uint8_t	length;	 // Length of the message to be printed
-	uint8_t buf[vtLCDMaxLen+1]; // On the way in, message to be sent, on the way out, message received (if any)
+	uint8_t buf[vtLCDBufLen+1]; // On the way in, message to be sent, on the way out, message received (if any)
 } vtLCDMsg;
 // end of defs
 
@@ -94,6 +102,8 @@ portBASE_TYPE SendLCDPrintMsg(vtLCDStruct *lcdData,int length,char *pString,port
 	lcdBuffer.length = strnlen(pString,vtLCDMaxLen);
 	lcdBuffer.msgType = LCDMsgTypePrint;
 	strncpy((char *)lcdBuffer.buf,pString,vtLCDMaxLen);
+	// strncpy() does not terminate a string of vtLCDMaxLen or more characters
+	lcdBuffer.buf[lcdBuffer.length] = '\0';
 	return(xQueueSend(lcdData->inQ,(void *) (&lcdBuffer),ticksToBlock));
 }
 
@@ -113,6 +123,22 @@ portBASE_TYPE SendLCDGraphMsg(vtLCDStruct *lcdData,uint8_t *data,portTickType ti
 	return(xQueueSend(lcdData->inQ,(void *) (&lcdBuffer),ticksToBlock));
 }	 
 
+portBASE_TYPE SendLCDGraphBlockMsg(vtLCDStruct *lcdData,uint8_t *data,uint8_t count,portTickType ticksToBlock)
+{
+	if (lcdData == NULL) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	vtLCDMsg lcdBuffer;
+	if (count > vtLCDMaxBlock) {
+		// no room for this message
+		VT_HANDLE_FATAL_ERROR(count);
+	}
+	lcdBuffer.length = count*8*sizeof(uint8_t);
+	memcpy(lcdBuffer.buf,data,lcdBuffer.length);
+	lcdBuffer.msgType = LCDMsgTypeGraphBlock;
+	return(xQueueSend(lcdData->inQ,(void *) (&lcdBuffer),ticksToBlock));
+}
+
 // Private routines used to unpack the message buffers
 //   I do not want to access the message buffer data structures outside of these routines
 portTickType unpackTimerMsg(vtLCDMsg *lcdBuffer)
@@ -161,6 +187,52 @@ struct Graph {
 	int size;
 	uint8_t data[GRAPHSIZE];
 };
+// Most readings taken out of the sample ring at a time
+#define lcdRingChunk 8
+// Where the spectrum goes: one bar per bin, bin 0 at the top, below the two lines of text
+#define lcdSpecTop 18
+#define lcdSpecHeight 208
+#define lcdSpecLeft 14
+#define lcdSpecWidth 300
+
+// Scale a value to the height of the graph area
+static int graphScale(int value)
+{
+	value = (value << 2);
+	value=(value*230)/1024;
+	return(230-value);
+}
+
+// Add one value to the graph
+static void graphAdd(struct Graph *g,int value)
+{
+	if(++g->position >= GRAPHSIZE) g->position = 0;
+	if(g->size < GRAPHSIZE) ++g->size;
+	g->data[g->position] = graphScale(value);
+}
+
+// Draw the latest spectrum -- at 512 points, each bar is the larger of two bins, so that they still fit
+//   The length of a bar is the level of the bin (see vtFFTLevel()): 6dB for every 8/128ths of the width
+static void drawSpectrum(vtFFT *fft)
+{
+	char line[48];
+	uint16_t bins = fft->len/2;
+	uint16_t group = (bins > 128) ? bins/128 : 1;
+	uint16_t rows = bins/group;
+	uint16_t pitch = lcdSpecHeight/rows;
+	uint16_t r, k, mag;
+
+	sprintf(line,"FFT %u pts  peak bin %u  %u cyc",fft->len,fft->peak,(unsigned int) fft->lastCycles);
+	GLCD_DisplayString(1,2,0,(unsigned char *) line);
+	for (r=0;r<rows;r++) {
+		mag = 0;
+		for (k=r*group;k<(r+1)*group;k++) {
+			if (fft->mag[k] > mag) mag = fft->mag[k];
+		}
+		// GLCD_Bargraph() takes 1024 for the full width
+		GLCD_Bargraph(lcdSpecLeft,lcdSpecTop+(r*pitch),lcdSpecWidth,(pitch > 1) ? pitch-1 : 1,vtFFTLevel(mag) << 3);
+	}
+}
 
 // This is the actual task that is run
 static portTASK_FUNCTION( vLCDUpdateTask, pvParameters )
@@ -188,6 +260,20 @@ static portTASK_FUNCTION( vLCDUpdateTask, pvParameters )
 	#endif
 	vtLCDMsg msgBuffer;
 	vtLCDStruct *lcdPtr = (vtLCDStruct *) pvParameters;
+	// Our place in the sample ring (if there is one)
+	vtSampleReader ringReader;
+	vtSample ringBuf[lcdRingChunk];
+	uint16_t ringCount;
+	// The latest capture from the trigger (if any) -- static to keep it off of the stack
+	static uint8_t capBuf[vtTriggerMaxCapture];
+	uint8_t capLen = 0, capNew;
+	// The statistics line
+	vtStatsSnap statsSnap;
+	char statsLine[48];
+
+	if (lcdPtr->ring != NULL) {
+		vtSampleReaderInit(&ringReader,lcdPtr->ring);
+	}
 
 	#ifdef INSPECT_STACK
 	// This is meant as an example that you can re-use in your own tasks
@@ -260,7 +346,55 @@ static portTASK_FUNCTION( vLCDUpdateTask, pvParameters )
 		// Take a different action depending on the type of the message that we received
 		switch(getMsgType(&msgBuffer)) {
 		case LCDMsgTypeTimer: {	
+			// Take whatever readings have come into the ring since the last time (if it got too far ahead of us, only
+			//   the latest ones are still there, which is all that fits on the graph anyway)
+			if (lcdPtr->ring != NULL) {
+				do {
+					ringCount = vtSampleRingRead(&ringReader,ringBuf,lcdRingChunk);
+					for (i=0;i<ringCount;i++) {
+						for (j=0;j<vtSampleLen;j++) {
+							graphAdd(&g,ringBuf[i].data[j]);
+						}
+						if (lcdPtr->fft != NULL) {
+							vtFFTAdd(lcdPtr->fft,ringBuf[i].data,vtSampleLen);
+						}
+					}
+				} while (ringCount == lcdRingChunk);
+			}
+			if (lcdPtr->trig != NULL) {
+				// taking it arms the trigger again, so the next one is caught while this one is on the screen
+				if ((capNew = vtTriggerTake(lcdPtr->trig,capBuf,NULL)) != 0) capLen = capNew;
+			}
 			GLCD_ClearWindow(6,0,314,232,Black);
+			if (lcdPtr->stats != NULL) {
+				// The statistics are kept up to date by the sensor task, so this is just a copy (no rescanning of the graph)
+				vtStatsGetSliding(lcdPtr->stats,&statsSnap);
+				if (statsSnap.count != 0) {
+					sprintf(statsLine,"min %3u max %3u avg %3u rms %3u p-p %3u",statsSnap.min,statsSnap.max,statsSnap.mean >> 8,
+						statsSnap.rms >> 8,statsSnap.p2p);
+					GLCD_DisplayString(0,2,0,(unsigned char *) statsLine);
+				}
+			}
+			if ((lcdPtr->fft != NULL) && (vtFFTRun(lcdPtr->fft) == pdTRUE)) {
+				// Spectrum mode (until enough readings have come in for the first one, the graph is shown as usual)
+				drawSpectrum(lcdPtr->fft);
+				break;
+			}
+			if (capLen != 0) {
+				// Show the capture, ending at the right edge like the rolling graph, with the trigger point marked
+				int xstart = 320-((capLen-1)*2);
+				GLCD_ClearWindow(xstart+(lcdPtr->trig->pre*2)-1,0,1,232,Yellow);
+				for (i=0;i<capLen;i++) {
+					int yvalue = graphScale(capBuf[i]);
+					int xvalue = xstart+(i*2);
+
+					GLCD_PutPixel(xvalue,yvalue); 
+					GLCD_PutPixel(xvalue-1,yvalue);
+					GLCD_PutPixel(xvalue,yvalue-1);
+					GLCD_PutPixel(xvalue-1,yvalue-1);
+				}
+				break;
+			}
 			// Graph values
 			int i = g.position;
 			int dataCount = 0;
@@ -278,18 +412,18 @@ static portTASK_FUNCTION( vLCDUpdateTask, pvParameters )
 			} while(i != g.position);
 			break;
 		}
-		case LCDMsgTypeGraph: {
+		case LCDMsgTypePrint: {
+			// Printed on the bottom line, to the right of the axis label (below the graph, so it is not cleared with it)
+			GLCD_DisplayString(29,33,0,msgBuffer.buf);
+			break;
+		}
+		case LCDMsgTypeGraph:
+		case LCDMsgTypeGraphBlock: {
 		
-			// Grab values
+			// Grab values (8 for each sample)
 			int i = 0;
-			for(i; i < 8; ++i) {
-				int value = msgBuffer.buf[i];
-				value = (value << 2);
-			   	value=(value*230)/1024;
-			   	value=230-value;	 		    
-				if(++g.position >= GRAPHSIZE) g.position = 0;
-				if(g.size < GRAPHSIZE) ++g.size;
-				g.data[g.position] = value; 
+			for(i; i < msgBuffer.length; ++i) {
+				graphAdd(&g,msgBuffer.buf[i]);
 			}				   
 			/*unsigned char displayMe[20];
 			sprintf(displayMe,"%02x,%02x,%02x,%02x,%02x,%02x,%02x,%02x",msgBuffer.buf[0],msgBuffer.buf[1],
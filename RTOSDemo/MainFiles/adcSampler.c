@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "projdefs.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "adcSampler.h"
+#include "lpc17xx_adc.h"
+#include "lpc17xx_clkpwr.h"
+#include "lpc17xx_gpdma.h"
+#include "lpc17xx_pinsel.h"
+
+/* *********************************************** */
+// definitions and data structures that are private to this file
+// Must be at or below configMAX_SYSCALL_INTERRUPT_PRIORITY (the notify function uses the FreeRTOS API)
+#define vtADCIntPriority 6
+// The ADC clock must not be above 13MHz, and a conversion takes 65 of its cycles
+#define vtADCMaxClock 13000000UL
+#define vtADCClocksPerConv 65UL
+// Pin (port, pin, function) of each ADC channel, AD0.0 to AD0.7
+//   AD0.2 is the potentiometer on the MCB1700; AD0.5 is also an LED, and AD0.6/AD0.7 are also UART0
+static const uint8_t vtADCPins[8][3] = {
+	{0,23,PINSEL_FUNC_1},{0,24,PINSEL_FUNC_1},{0,25,PINSEL_FUNC_1},{0,26,PINSEL_FUNC_1},
+	{1,30,PINSEL_FUNC_3},{1,31,PINSEL_FUNC_3},{0,3,PINSEL_FUNC_2},{0,2,PINSEL_FUNC_2}
+};
+static LPC_GPDMACH_TypeDef * const vtADCDMACh[8] = {
+	LPC_GPDMACH0,LPC_GPDMACH1,LPC_GPDMACH2,LPC_GPDMACH3,LPC_GPDMACH4,LPC_GPDMACH5,LPC_GPDMACH6,LPC_GPDMACH7
+};
+// The one that was started (for the interrupt handler)
+static vtADCStruct *vtADCActive = NULL;
+// end of defs
+/* *********************************************** */
+
+/* ************************************************ */
+// Public API Functions
+//
+int vtADCInit(vtADCStruct *adc,uint8_t channels,uint32_t rate,uint8_t dmaNum)
+{
+	PINSEL_CFG_Type pinCfg;
+	GPDMA_Channel_CFG_Type dmaCfg;
+	LPC_GPDMACH_TypeDef *dmaCh;
+	uint32_t pclk, div, minDiv;
+	uint8_t n;
+
+	if ((channels == 0) || (rate == 0) || (rate > 200000) || (dmaNum > 7)) {
+		return(vtADCErrInit);
+	}
+	// ADC_Init() rounds the divider down, which can clock the ADC above 13MHz (and so convert faster than asked), and
+	//   does not check that it fits in the 8 bits of CLKDIV -- so the divider (CLKDIV+1) is worked out here instead:
+	//   the smallest one that keeps to both the rate asked for and the 13MHz limit
+	pclk = CLKPWR_GetPCLK(CLKPWR_PCLKSEL_ADC);
+	div = (pclk + rate*vtADCClocksPerConv - 1) / (rate*vtADCClocksPerConv);
+	minDiv = (pclk + vtADCMaxClock - 1) / vtADCMaxClock;
+	if (div < minDiv) div = minDiv;
+	if (div > 256) {
+		// too slow for this PCLK
+		return(vtADCErrInit);
+	}
+	adc->channels = channels;
+	adc->dmaNum = dmaNum;
+	adc->rate = pclk / (div * vtADCClocksPerConv);
+	adc->notify = NULL;
+	adc->notifyArg = NULL;
+	adc->filled = 0;
+	adc->errors = 0;
+
+	// Switch the pins over to the ADC (no pull up or down, which would upset the reading)
+	pinCfg.Pinmode = PINSEL_PINMODE_TRISTATE;
+	pinCfg.OpenDrain = PINSEL_PINMODE_NORMAL;
+	for (n=0;n<8;n++) {
+		if (!(channels & (1 << n))) continue;
+		pinCfg.Portnum = vtADCPins[n][0];
+		pinCfg.Pinnum = vtADCPins[n][1];
+		pinCfg.Funcnum = vtADCPins[n][2];
+		PINSEL_ConfigPin(&pinCfg);
+	}
+
+	// Each of the channels asks for a DMA transfer when its conversion is done -- the ADC interrupt is not used at all
+	ADC_Init(LPC_ADC,rate);
+	LPC_ADC->ADCR = ADC_CR_PDN | ADC_CR_CLKDIV((div-1));
+	ADC_IntConfig(LPC_ADC,ADC_ADGINTEN,DISABLE);
+	for (n=0;n<8;n++) {
+		if (!(channels & (1 << n))) continue;
+		ADC_ChannelCmd(LPC_ADC,n,ENABLE);
+		ADC_IntConfig(LPC_ADC,(ADC_TYPE_INT_OPT) n,ENABLE);
+	}
+	NVIC_DisableIRQ(ADC_IRQn);
+
+	// The DMA copies the global data register into buf[0], then follows lli[1] into buf[1], then lli[0] back into
+	//   buf[0], and so on for good
+	GPDMA_Init();
+	dmaCfg.ChannelNum = dmaNum;
+	dmaCfg.TransferSize = vtADCHalfLen;
+	dmaCfg.TransferWidth = 0;
+	dmaCfg.SrcMemAddr = 0;
+	dmaCfg.DstMemAddr = (uint32_t) adc->buf[0];
+	dmaCfg.TransferType = GPDMA_TRANSFERTYPE_P2M;
+	dmaCfg.SrcConn = GPDMA_CONN_ADC;
+	dmaCfg.DstConn = 0;
+	dmaCfg.DMALLI = (uint32_t) &(adc->lli[1]);
+	if (GPDMA_Setup(&dmaCfg) != SUCCESS) {
+		return(vtADCErrInit);
+	}
+	// the linked list items do exactly what GPDMA_Setup() set up for the first buffer
+	dmaCh = vtADCDMACh[dmaNum];
+	for (n=0;n<2;n++) {
+		adc->lli[n].SrcAddr = dmaCh->DMACCSrcAddr;
+		adc->lli[n].DstAddr = (uint32_t) adc->buf[n];
+		adc->lli[n].NextLLI = (uint32_t) &(adc->lli[1-n]);
+		adc->lli[n].Control = dmaCh->DMACCControl;
+	}
+	return(vtADCInitSuccess);
+}
+
+portBASE_TYPE vtADCStart(vtADCStruct *adc,vtADCNotify notify,void *arg)
+{
+	if ((vtADCActive != NULL) || (notify == NULL)) {
+		return(pdFALSE);
+	}
+	adc->notify = notify;
+	adc->notifyArg = arg;
+	vtADCActive = adc;
+	NVIC_SetPriority(DMA_IRQn,vtADCIntPriority);
+	NVIC_EnableIRQ(DMA_IRQn);
+	GPDMA_ChannelCmd(adc->dmaNum,ENABLE);
+	ADC_BurstCmd(LPC_ADC,ENABLE);
+	return(pdTRUE);
+}
+
+portBASE_TYPE vtADCLapped(vtADCStruct *adc,uint32_t seq)
+{
+	// the DMA starts on this buffer again as soon as it has filled the one after it
+	return((adc->filled - seq >= 2) ? pdTRUE : pdFALSE);
+}
+// End of public API Functions
+/* ************************************************ */
+
+// GPDMA interrupt handler -- once per full buffer (the DMA has already gone on into the other one)
+void DMA_IRQHandler(void)
+{
+	static signed portBASE_TYPE xHigherPriorityTaskWoken;
+	vtADCStruct *adc = vtADCActive;
+	uint32_t seq;
+
+	xHigherPriorityTaskWoken = pdFALSE;
+	if (GPDMA_IntGetStatus(GPDMA_STAT_INTTC,adc->dmaNum) == SET) {
+		GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC,adc->dmaNum);
+		seq = adc->filled++;
+		adc->notify(seq & 1,seq,portGET_RUN_TIME_COUNTER_VALUE(),adc->notifyArg,&xHigherPriorityTaskWoken);
+	}
+	if (GPDMA_IntGetStatus(GPDMA_STAT_INTERR,adc->dmaNum) == SET) {
+		GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR,adc->dmaNum);
+		adc->errors++;
+	}
+	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
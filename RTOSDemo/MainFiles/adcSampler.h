@@ -0,0 +1,73 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+#include "FreeRTOS.h"
+#include "lpc17xx_gpdma.h"
+// On-chip ADC as a sample source
+//   The ADC runs in burst mode over the selected channels (one after the other, at up to 200K conversions per second in
+//   all), and a GPDMA channel copies each result (the whole global data register: the value and its channel number)
+//   into one of two buffers.  The two DMA linked list items point at each other, so the DMA goes on into the other
+//   buffer by itself when one is full -- the CPU only hears about it once per full buffer, through a notify function
+//   called from the DMA interrupt handler.  That buffer is then left alone until the DMA comes back around to it, so
+//   whoever is notified has to be done with it within vtADCHalfLen conversions.
+//
+// Number of conversions in each of the two buffers (up to 4095)
+#define vtADCHalfLen 512
+// return codes for vtADCInit()
+#define vtADCInitSuccess 0
+#define vtADCErrInit -1
+
+// Called from the DMA interrupt handler each time a buffer is full
+//   half: which buffer (0 or 1)
+//   seq: number of the buffer (counting from 0) -- see vtADCLapped()
+//   stamp: run time counter value at which it was filled (that of its last conversion -- the others came before it,
+//     at rate)
+//   arg: as given to vtADCStart()
+//   pxHigherPriorityTaskWoken: as for the FromISR() calls of FreeRTOS
+typedef void (*vtADCNotify)(uint8_t half,uint32_t seq,uint32_t stamp,void *arg,signed portBASE_TYPE *pxHigherPriorityTaskWoken);
+
+typedef struct __vtADCStruct {
+	uint8_t channels;					// Channels converted (bit n for AD0.n)
+	uint8_t dmaNum;						// GPDMA channel used (0-7)
+	uint32_t rate;						// Conversions per second (over all of the channels) that the ADC really runs at
+	vtADCNotify notify;
+	void *notifyArg;
+	uint32_t buf[2][vtADCHalfLen];		// Raw global data register values, as copied by the DMA
+	GPDMA_LLI_Type lli[2];				// lli[n] fills buf[n] and then goes on to the other one
+	volatile uint32_t filled;			// Number of buffers filled so far
+	uint32_t errors;					// Number of DMA errors
+} vtADCStruct;
+
+/* ********************************************************************* */
+// The following are the public API calls to work with the ADC sampler
+
+// Args:
+//   adc: pointer to the vtADCStruct data structure
+//   channels: the channels to convert (bit n for AD0.n) -- their pins are switched over to the ADC
+//   rate: conversions per second over all of the channels (up to 200000) -- the ADC runs at the fastest rate it can
+//     reach that is no faster than this (and keeps its clock at or below 13MHz), which is put in adc->rate; with PCLK_ADC
+//     at 25MHz that is 192307 at most, and rates below about 1503 cannot be reached at all
+//   dmaNum: the GPDMA channel to use (0-7)
+// Return:
+//   if successful, returns vtADCInitSuccess
+//   if not (including a rate that cannot be reached), returns vtADCErrInit
+// Nothing is converted until vtADCStart() is called
+int vtADCInit(vtADCStruct *adc,uint8_t channels,uint32_t rate,uint8_t dmaNum);
+
+// Start converting (only one vtADCStruct can be started -- there is one ADC)
+// Args:
+//   adc: pointer to the vtADCStruct data structure
+//   notify: called from the DMA interrupt handler each time a buffer is full
+//   arg: passed to notify as is
+// Return:
+//   pdTRUE if it started
+portBASE_TYPE vtADCStart(vtADCStruct *adc,vtADCNotify notify,void *arg);
+
+// Has the DMA come back around to buffer number seq (as given to notify) and started to write over it?
+//   Check this once done with a buffer: if so, what was read out of it may be a mix of old and new values
+// Args:
+//   adc: pointer to the vtADCStruct data structure
+//   seq: number of the buffer
+// Return:
+//   pdTRUE if it has
+portBASE_TYPE vtADCLapped(vtADCStruct *adc,uint32_t seq);
+#endif
@@ -33,66 +33,173 @@
 
 /* The i2cTemp task. */
 static portTASK_FUNCTION_PROTO( vConductorUpdateTask, pvParameters );
+static void conductorToVolt(vtI2CMsg * const *msgs,uint8_t count,void *arg);
 
 /*-----------------------------------------------------------*/
 // Public API
 void vStartConductorTask(vtConductorStruct *params,unsigned portBASE_TYPE uxPriority, vtI2CStruct *i2c,vtVoltStruct *voltage)
 {
+	int i;
+
 	/* Start the task */
 	portBASE_TYPE retval;
 	params->dev = i2c;
 	params->voltData = voltage;
+	params->unrouted = 0;
+	for (i=0;i<vtConductorMaxMsgType;i++) {
+		params->route[i] = NULL;
+	}
+	for (i=0;i<vtI2CPoolLen;i++) {
+		params->refs[i] = 0;
+	}
+	// The sensor task gets its results copied into its own queue, as before
+	if (voltage != NULL) {
+		for (i=0;i<2;i++) {
+			params->voltSub[i].q = NULL;
+			params->voltSub[i].handler = conductorToVolt;
+			params->voltSub[i].filter = NULL;
+			params->voltSub[i].arg = voltage;
+		}
+		vtConductorSubscribe(params,vtI2CMsgTypeVoltInit,&(params->voltSub[0]));
+		vtConductorSubscribe(params,vtI2CMsgTypeVoltRead,&(params->voltSub[1]));
+	}
 	if ((retval = xTaskCreate( vConductorUpdateTask, ( signed char * ) "Conductor", conSTACK_SIZE, (void *) params, uxPriority, ( xTaskHandle * ) NULL )) != pdPASS) {
 		VT_HANDLE_FATAL_ERROR(retval);
 	}
 }
 
+portBASE_TYPE vtConductorSubscribe(vtConductorStruct *conductorData,uint8_t msgType,vtConductorSub *sub)
+{
+	if (msgType >= vtConductorMaxMsgType) {
+		return(pdFALSE);
+	}
+	sub->dropped = 0;
+	// The conductor may be walking the list right now; it sees either the old or the new head, and both are whole lists
+	taskENTER_CRITICAL();
+	sub->next = conductorData->route[msgType];
+	conductorData->route[msgType] = sub;
+	taskEXIT_CRITICAL();
+	return(pdTRUE);
+}
+
+void vtConductorRelease(vtConductorStruct *conductorData,vtI2CMsg *msg)
+{
+	uint8_t left;
+
+	taskENTER_CRITICAL();
+	left = --(conductorData->refs[msg - conductorData->dev->pool]);
+	taskEXIT_CRITICAL();
+	if (left == 0) {
+		vtI2CMsgRelease(conductorData->dev,msg);
+	}
+}
+
 // End of Public API
 /*-----------------------------------------------------------*/
 
+// Subscriber for the sensor task: copy the results into its queue (it drains that queue the same way, and puts the
+//   readings together into one block for the LCD)
+static void conductorToVolt(vtI2CMsg * const *msgs,uint8_t count,void *arg)
+{
+	uint8_t i;
+
+	for (i=0;i<count;i++) {
+		SendVoltResultMsg((vtVoltStruct *) arg,msgs[i],portMAX_DELAY);
+	}
+}
+
+// Hand one block to a subscriber
+static void conductorDeliver(vtConductorStruct *param,vtConductorSub *sub,vtConductorBlock *block)
+{
+	uint8_t i;
+
+	if (sub->q == NULL) {
+		sub->handler(block->msgs,block->count,sub->arg);
+		return;
+	}
+	taskENTER_CRITICAL();
+	for (i=0;i<block->count;i++) {
+		param->refs[block->msgs[i] - param->dev->pool]++;
+	}
+	taskEXIT_CRITICAL();
+	if (xQueueSend(sub->q,(void *) block,0) != pdTRUE) {
+		sub->dropped += block->count;
+		for (i=0;i<block->count;i++) {
+			vtConductorRelease(param,block->msgs[i]);
+		}
+	}
+}
+
 // This is the actual task that is run
 static portTASK_FUNCTION( vConductorUpdateTask, pvParameters )
 {
-	uint8_t rxLen, status;
-	uint8_t Buffer[vtI2CMLen];
-	uint8_t *valPtr = &(Buffer[0]);
+	vtI2CMsg *batch[vtI2CPoolLen];
+	uint8_t taken[vtI2CPoolLen];
+	vtConductorBlock block;
 	
 	// Get the parameters
 	vtConductorStruct *param = (vtConductorStruct *) pvParameters;
 	// Get the I2C device pointer
 	vtI2CStruct *devPtr = param->dev;
-	// Get the LCD information pointer
-	vtVoltStruct *voltData = param->voltData;
-	uint8_t recvMsgType;
+	vtConductorSub *sub;
+	uint8_t recvMsgType, count, i, j;
 
 	// Like all good tasks, this should never exit
 	for(;;)
 	{
-		// Wait for a message from an I2C operation
-		if (vtI2CDeQ(devPtr,vtI2CMLen,Buffer,&rxLen,&recvMsgType,&status) != pdTRUE) {
+		// Wait for a message from an I2C operation, and once one comes in, take everything else that is already
+		//   waiting before routing (so a burst of results costs one wakeup, and one block per subscriber)
+		//   The data is read straight out of the I2C descriptors, which go back to the pool afterwards
+		if (vtI2CMsgWait(devPtr,&(batch[0]),portMAX_DELAY) != pdTRUE) {
 			VT_HANDLE_FATAL_ERROR(0);
 		}
+		count = 1;
+		while ((count < vtI2CPoolLen) && (vtI2CMsgWait(devPtr,&(batch[count]),0) == pdTRUE)) {
+			count++;
+		}
 
-		// Decide where to send the message 
-		//   This just shows going to one task/queue, but you could easily send to
-		//   other Q/tasks for other message types
+		// Decide where to send the messages
 		// This isn't a state machine, it is just acting as a router for messages
-		switch(recvMsgType) {
-		case vtI2CMsgTypeVoltInit: {
-			SendVoltValueMsg(voltData,recvMsgType,Buffer,0,portMAX_DELAY);
-			break;
+		// We hold on to the descriptors ourselves until every subscriber has them, so they cannot go back to the pool early
+		for (i=0;i<count;i++) {
+			if (batch[i]->msgType >= vtConductorMaxMsgType) {
+				VT_HANDLE_FATAL_ERROR(batch[i]->msgType);
+			}
+			param->refs[batch[i] - devPtr->pool] = 1;
+			taken[i] = 0;
 		}
-		case vtI2CMsgTypeVoltRead: {
-			SendVoltValueMsg(voltData,recvMsgType,Buffer,8,portMAX_DELAY);
-			break;
+		for (i=0;i<count;i++) {
+			// Each message type is routed once, at its first message in the drain
+			recvMsgType = batch[i]->msgType;
+			for (j=0;j<i;j++) {
+				if (batch[j]->msgType == recvMsgType) break;
+			}
+			if (j < i) {
+				continue;
+			}
+			for (sub=param->route[recvMsgType];sub!=NULL;sub=sub->next) {
+				block.count = 0;
+				for (j=i;j<count;j++) {
+					if (batch[j]->msgType != recvMsgType) {
+						continue;
+					}
+					if ((sub->filter != NULL) && (sub->filter(batch[j],sub->arg) != pdTRUE)) {
+						continue;
+					}
+					block.msgs[block.count++] = batch[j];
+					taken[j] = 1;
+				}
+				if (block.count != 0) {
+					conductorDeliver(param,sub,&block);
+				}
+			}
 		}
-		default: {
-			VT_HANDLE_FATAL_ERROR(recvMsgType);
-			break;
+		for (i=0;i<count;i++) {
+			if (!taken[i]) {
+				param->unrouted++;
+			}
+			vtConductorRelease(param,batch[i]);
 		}
-		}
-
-
 	}
 }
 
@@ -2,22 +2,77 @@
 #define CONDUCTOR_H
 #include "vtI2C.h"
 #include "i2cVolt.h"
+// Message types that can be routed (the routing table is indexed directly by msgType, so they must all be below this)
+#define vtConductorMaxMsgType 16
+
+// The results that one subscriber takes out of one drain of the I2C output queue, in the order they came in
+//   (there are never more than vtI2CPoolLen descriptors around, so that is the most a block can hold)
+typedef struct __ConductorBlock {
+	uint8_t count;
+	vtI2CMsg *msgs[vtI2CPoolLen];
+} vtConductorBlock;
+
+// A subscriber to one message type
+//   The conductor takes everything waiting on the I2C output queue at once, and each subscriber gets one block
+//   (see vtConductorBlock) with all of the messages it takes from that drain
+//   Either q or handler is filled in:
+//     q: queue of vtConductorBlock -- every subscriber gets pointers to the same descriptors (nothing is copied), and
+//        each one must call vtConductorRelease() on every descriptor in the block once it is done; it must not change
+//        them.  The send never blocks, so a subscriber whose queue is full misses that block (see dropped)
+//     handler: called from the conductor task with the descriptors, which it must not keep or block on for long
+//   filter: if not NULL, a message only goes to this subscriber if filter returns pdTRUE
+//   The storage belongs to the subscriber and must stay around for good (there is no unsubscribe)
+struct __ConductorSub;
+typedef void (*vtConductorHandler)(vtI2CMsg * const *msgs,uint8_t count,void *arg);
+typedef portBASE_TYPE (*vtConductorFilter)(const vtI2CMsg *msg,void *arg);
+typedef struct __ConductorSub {
+	xQueueHandle q;
+	vtConductorHandler handler;
+	vtConductorFilter filter;
+	void *arg;						// Passed to handler and filter as is
+	// Used by the conductor -- do not touch
+	uint32_t dropped;				// Number of messages that did not fit in q
+	struct __ConductorSub *next;
+} vtConductorSub;
+
 // Structure used to pass parameters to the task
 // Do not touch...
 typedef struct __ConductorStruct {
 	vtI2CStruct *dev;
 	vtVoltStruct *voltData;
+	vtConductorSub * volatile route[vtConductorMaxMsgType];	// The subscribers to each message type
+	uint8_t refs[vtI2CPoolLen];		// Number of subscribers still holding each descriptor of the I2C pool
+	uint32_t unrouted;				// Number of messages that no subscriber took
+	vtConductorSub voltSub[2];		// The subscriptions of the sensor task
 } vtConductorStruct;
 
 // Public API
 //
 // The job of this task is to read from the message queue that is output by the I2C thread and to distribute the messages to the right
-//   threads.  Right now, they are only going to one thread, but it should be clear from the structure of this task how that would be done.
+//   threads, as set up in a routing table from message type to subscribers.  Any task can subscribe, at startup or later on.
+//   Only the results of I2C operations sent without a completion target reach this task -- tasks that use vtI2CEnQReply()
+//   or vtI2CEnQCallback() get their results directly and do not need it.
 // Start the task
 // Args:
 //   conductorData: Data structure used by the task
 //   uxPriority -- the priority you want this task to be run at
 //   i2c: pointer to the data structure for an i2c task
-//   temperature: pointer to the data structure for an LCD task (may be NULL)
+//   voltage: pointer to the data structure for the sensor task (may be NULL) -- it is subscribed to its own message types
 void vStartConductorTask(vtConductorStruct *conductorData,unsigned portBASE_TYPE uxPriority, vtI2CStruct *i2c,vtVoltStruct *voltage);
-#endif
\ No newline at end of file
+//
+// Add a subscriber to a message type (see vtConductorSub) -- can be called from any task once the conductor is started
+// Args:
+//   conductorData: Data structure used by the task
+//   msgType: the message type to subscribe to
+//   sub: the subscriber, with q or handler (and optionally filter and arg) filled in
+// Return:
+//   pdTRUE, or pdFALSE if msgType is too large for the routing table
+portBASE_TYPE vtConductorSubscribe(vtConductorStruct *conductorData,uint8_t msgType,vtConductorSub *sub);
+//
+// Let go of a descriptor that was received on a subscriber queue (it goes back to the I2C pool once every subscriber
+//   has let go of it)
+// Args:
+//   conductorData: Data structure used by the task
+//   msg: the descriptor
+void vtConductorRelease(vtConductorStruct *conductorData,vtI2CMsg *msg);
+#endif
@@ -14,16 +14,29 @@
 #include "vtI2C.h"
 #include "LCDtask.h"
 #include "i2cVolt.h"
+#include "sensorDrivers.h"
 #include "I2CTaskMsgTypes.h"
+#include "myTimers.h"
+#include "lpc17xx_adc.h"
 
 /* *********************************************** */
 // definitions and data structures that are private to this file
 // Length of the queue to this task
 #define vtVoltQLen 10 
+// How often the sensor is read
+#define voltPollPeriod ( ( portTickType ) 32 / portTICK_RATE_MS)
+#define voltPollPeriodUs (32000UL)
+// How long to wait before trying again to set up a sensor that did not answer
+#define voltInitRetry ( ( portTickType ) 1000 / portTICK_RATE_MS)
+// How often the sample rate is worked out and shown, in run time counter ticks (the counter runs at 10KHz, see main.c)
+#define voltRunTimeHz (10000UL)
+#define voltRateInterval (voltRunTimeHz)
 // actual data structure that is sent in a message
 typedef struct __vtVoltMsg {
 	uint8_t msgType;
 	uint8_t	length;	 // Length of the message to be printed
+	uint32_t stamp;	 // Run time counter value at which the value was sampled
+	uint8_t status;	 // For the results of I2C operations, as in vtI2CMsg (vtI2CStatusOk for everything else)
 	uint8_t buf[vtVoltMaxLen+1]; // On the way in, message to be sent, on the way out, message received (if any)
 } vtVoltMsg;
 
@@ -72,23 +85,51 @@ portBASE_TYPE SendVoltTimerMsg(vtVoltStruct *voltData,portTickType ticksElapsed,
 	}
 	memcpy(voltBuffer.buf,(char *)&ticksElapsed,sizeof(ticksElapsed));
 	voltBuffer.msgType = VoltMsgTypeTimer;
+	voltBuffer.status = vtI2CStatusOk;
 	return(xQueueSend(voltData->inQ,(void *) (&voltBuffer),ticksToBlock));
 }
 
 portBASE_TYPE SendVoltValueMsg(vtVoltStruct *voltData,uint8_t msgType,uint8_t *value,uint8_t size,portTickType ticksToBlock)
+{
+	return(SendVoltSampleMsg(voltData,msgType,value,size,portGET_RUN_TIME_COUNTER_VALUE(),ticksToBlock));
+}
+
+portBASE_TYPE SendVoltSampleMsg(vtVoltStruct *voltData,uint8_t msgType,uint8_t *value,uint8_t size,uint32_t stamp,portTickType ticksToBlock)
 {
 	vtVoltMsg voltBuffer;
 
 	if (voltData == NULL) {
 		VT_HANDLE_FATAL_ERROR(0);
 	}
-	voltBuffer.length = sizeof(value);
+	voltBuffer.length = size;
 	if (voltBuffer.length > vtVoltMaxLen) {
 		// no room for this message
 		VT_HANDLE_FATAL_ERROR(voltBuffer.length);
 	}
 	memcpy(voltBuffer.buf,(char *)value,size*sizeof(uint8_t)); //### 
 	voltBuffer.msgType = msgType;
+	voltBuffer.stamp = stamp;
+	voltBuffer.status = vtI2CStatusOk;
+	return(xQueueSend(voltData->inQ,(void *) (&voltBuffer),ticksToBlock));
+}
+
+portBASE_TYPE SendVoltResultMsg(vtVoltStruct *voltData,vtI2CMsg *msg,portTickType ticksToBlock)
+{
+	vtVoltMsg voltBuffer;
+
+	if (voltData == NULL) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	voltBuffer.length = msg->rxLen;
+	if (voltBuffer.length > vtVoltMaxLen) {
+		// no room for this message
+		VT_HANDLE_FATAL_ERROR(voltBuffer.length);
+	}
+	memcpy(voltBuffer.buf,msg->rxBuf,msg->rxLen);
+	voltBuffer.msgType = msg->msgType;
+	// The time at which the read was started (by the I2C task or by the hardware timer) is the time of the sample
+	voltBuffer.stamp = msg->tEnq;
+	voltBuffer.status = msg->status;
 	return(xQueueSend(voltData->inQ,(void *) (&voltBuffer),ticksToBlock));
 }
 
@@ -106,13 +147,188 @@ void getValue(uint8_t *source,vtVoltMsg *Buffer,uint8_t size)
 	memcpy(source,Buffer->buf,size);
 }
 
+// Called from the I2C task when one of our I2C operations completes
+//   This sends the result straight to this task, so no other task has to route it here
+static void voltI2CDone(vtI2CMsg *msg,void *arg)
+{
+	vtVoltStruct *voltData = (vtVoltStruct *) arg;
+	// Make this non-blocking so that the I2C bus is never held up by this task -- if the task has fallen that far
+	//   behind, the reading is lost (the set up result cannot be, as nothing else is in the queue at that point)
+	if (SendVoltResultMsg(voltData,msg,0) != pdTRUE) {
+		voltData->dropped++;
+	}
+}
+
 // I2C commands for the temperature sensor
-const uint8_t i2cCmdInit[]= {0xAC,0x00};
-const uint8_t i2cCmdStartConvert[]= {0xEE};
 const uint8_t i2cCmdStopConvert[]= {0x22};
 const uint8_t i2cCmdRead1Vals[]= {0xAA};
+// The address of the sensor and its whole configuration sequence, run by the I2C task in one go (see
+//   vtI2CEnQProgram()), come from its descriptor (see sensorDrivers.h)
+#define voltSlvAddr (vtSensorVolt.slvAddr)
+#define voltProgInit (vtSensorVolt.initProg)
 // end of I2C command definitions
 
+// Hand a block of readings on to the LCD (unless it gets them from the sample ring) and publish the latest one for the external master (if any)
+static void voltSendBlock(vtVoltStruct *param,uint8_t *block,uint8_t count,uint32_t samples,uint32_t stamp)
+{
+	vtStatsSnap snap;
+
+	if (count == 0) return;
+	if (param->slave != NULL) {
+		// Register map: 0-7 the latest reading, 8-11 the number of readings, 12-15 the time it was taken (in run time
+		//   counter ticks), and if there are statistics, those of the sliding window: 16 min, 17 max, 18-19 mean,
+		//   20-21 rms (both in 1/256ths), 22-25 variance (in 1/256ths), and those of the latest tumbling window to
+		//   finish: 26 min, 27 max, 28-29 mean, 30-31 rms (all 0 until one has) -- all little endian
+		uint8_t *map = vtI2CSlaveBeginUpdate(param->slave);
+		if (map != NULL) {
+			memcpy(map,&(block[(count-1)*8]),8);
+			memcpy(&(map[8]),&samples,sizeof(samples));
+			memcpy(&(map[12]),&stamp,sizeof(stamp));
+			if (param->stats != NULL) {
+				vtStatsGetSliding(param->stats,&snap);
+				map[16] = snap.min;
+				map[17] = snap.max;
+				memcpy(&(map[18]),&(snap.mean),sizeof(snap.mean));
+				memcpy(&(map[20]),&(snap.rms),sizeof(snap.rms));
+				memcpy(&(map[22]),&(snap.var),sizeof(snap.var));
+				vtStatsGetTumbling(param->stats,&snap);
+				map[26] = snap.min;
+				map[27] = snap.max;
+				memcpy(&(map[28]),&(snap.mean),sizeof(snap.mean));
+				memcpy(&(map[30]),&(snap.rms),sizeof(snap.rms));
+			}
+			vtI2CSlavePublish(param->slave);
+		}
+	}
+	if ((param->lcdData != NULL) && (param->ring == NULL)) {
+		if (SendLCDGraphBlockMsg(param->lcdData,block,count,portMAX_DELAY) != pdTRUE) {
+			VT_HANDLE_FATAL_ERROR(0);
+		}
+	}
+}
+
+// What the task keeps from one reading to the next
+typedef struct __voltPipe {
+	// Readings that have come in since the last block was sent on
+	uint8_t block[8*vtLCDMaxBlock];
+	uint8_t blockCount;
+	// Filter outputs that do not yet make up a whole reading
+	uint8_t filtBuf[8];
+	uint8_t filtCount;
+	// Number of readings so far, and the time of the latest one
+	uint32_t samples;
+	uint32_t stamp;
+	// Values received since rateStart, for working out the sample rate
+	uint32_t rateCount;
+	uint32_t rateStart;
+	// ADC values that do not yet make up a whole reading, and the channel they come from
+	uint8_t adcReading[8];
+	uint8_t adcCount;
+	uint8_t adcChannel;
+} voltPipe;
+
+// Take one reading (8 values) through the trigger, the statistics and the filter, and on to the ring and the LCD
+static void voltAddReading(vtVoltStruct *param,voltPipe *pipe,const uint8_t *reading,uint32_t stamp)
+{
+	uint8_t *dst;
+
+	pipe->samples++;
+	pipe->stamp = stamp;
+	pipe->rateCount += 8;
+	if (param->trig != NULL) {
+		// every value is checked as it comes in, so nothing short goes by between LCD updates
+		vtTriggerBlock(param->trig,reading,8,stamp);
+	}
+	if (param->stats != NULL) {
+		vtStatsBlock(param->stats,reading,8,stamp);
+	}
+	dst = &(pipe->block[pipe->blockCount*8]);
+	if (param->filter != NULL) {
+		// the filter gives 8/decim values per reading, so it takes decim readings to make one to pass on
+		pipe->filtCount += vtVoltFilterBlock(param->filter,reading,&(pipe->filtBuf[pipe->filtCount]));
+		if (pipe->filtCount < 8) return;
+		pipe->filtCount = 0;
+		memcpy(dst,pipe->filtBuf,8);
+	} else {
+		memcpy(dst,reading,8);
+	}
+	if (param->ring != NULL) {
+		vtSampleRingPut(param->ring,dst,stamp);
+	}
+	if (++pipe->blockCount == vtLCDMaxBlock) {
+		voltSendBlock(param,pipe->block,pipe->blockCount,pipe->samples,stamp);
+		pipe->blockCount = 0;
+	}
+}
+
+// Show how many values per second are really coming in (and, if they are filtered, the most that the filter has taken
+//   to do one reading, in CPU cycles) -- at most once every voltRateInterval, and only when streaming, filtering or
+//   sampling with the ADC (otherwise the rate is just the poll period, and the line would only clutter the LCD)
+static void voltShowRate(vtVoltStruct *param,voltPipe *pipe)
+{
+	char rateBuf[vtLCDMaxLen+1];
+	uint32_t elapsed = pipe->stamp - pipe->rateStart;
+
+	if ((param->streamLen == 0) && (param->filter == NULL) && (param->adc == NULL)) return;
+	if (elapsed < voltRateInterval) return;
+	if (param->filter != NULL) {
+		snprintf(rateBuf,sizeof(rateBuf),"%6u S/s %4u cyc",(unsigned int) ((pipe->rateCount * voltRunTimeHz) / elapsed),
+			(unsigned int) param->filter->maxCycles);
+	} else {
+		snprintf(rateBuf,sizeof(rateBuf),"%6u S/s",(unsigned int) ((pipe->rateCount * voltRunTimeHz) / elapsed));
+	}
+	if ((param->lcdData != NULL) && (SendLCDPrintMsg(param->lcdData,strlen(rateBuf),rateBuf,portMAX_DELAY) != pdTRUE)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	pipe->rateCount = 0;
+	pipe->rateStart = pipe->stamp;
+}
+
+// Called from the DMA interrupt handler each time the ADC has filled a buffer (see adcSampler.h)
+//   Only the number of the buffer is sent -- the task reads the values straight out of it
+static void voltADCNotify(uint8_t half,uint32_t seq,uint32_t stamp,void *arg,signed portBASE_TYPE *pxHigherPriorityTaskWoken)
+{
+	vtVoltStruct *voltData = (vtVoltStruct *) arg;
+	vtVoltMsg voltBuffer;
+
+	voltBuffer.msgType = VoltMsgTypeADC;
+	voltBuffer.status = vtI2CStatusOk;
+	voltBuffer.length = sizeof(seq);
+	voltBuffer.stamp = stamp;
+	memcpy(voltBuffer.buf,&seq,sizeof(seq));
+	// Never wait in an interrupt handler: if the queue is full, the task is far enough behind that it would have been
+	//   lapped on this buffer anyway
+	if (xQueueSendFromISR(voltData->inQ,&voltBuffer,pxHigherPriorityTaskWoken) != pdTRUE) {
+		voltData->adcMissed++;
+	}
+}
+
+// Take the values of one ADC channel out of a full buffer, as 8 bit readings of 8 values each
+//   The buffer holds the conversions of all of the selected channels in turn; only the lowest one is used here
+//   stamp is the time the buffer was filled, i.e. of its last conversion; the conversions come at adc->rate, so each
+//   reading gets the time of its own last value, worked back from there
+static void voltAddADC(vtVoltStruct *param,voltPipe *pipe,uint32_t seq,uint32_t stamp)
+{
+	const uint32_t *buf = param->adc->buf[seq & 1];
+	uint32_t word;
+	uint16_t k;
+
+	for (k=0;k<vtADCHalfLen;k++) {
+		word = buf[k];
+		if (ADC_GDR_CH(word) != pipe->adcChannel) continue;
+		// 12 bits down to the 8 of the readings from the sensor
+		pipe->adcReading[pipe->adcCount++] = (uint8_t) (ADC_GDR_RESULT(word) >> 4);
+		if (pipe->adcCount == 8) {
+			voltAddReading(param,pipe,pipe->adcReading,stamp - ((vtADCHalfLen-1-k) * voltRunTimeHz) / param->adc->rate);
+			pipe->adcCount = 0;
+		}
+	}
+	// If the DMA has already come back around to this buffer, some of those values were newer than the rest
+	if (vtADCLapped(param->adc,seq) == pdTRUE) {
+		param->adcLapped++;
+	}
+}
+
 // State Machine
 const uint8_t fsmStateInitSent = 0;
 const uint8_t fsmStateVoltRead = 1;
@@ -123,84 +339,167 @@ static portTASK_FUNCTION( vi2cVoltUpdateTask, pvParameters )
 	vtVoltStruct *param = (vtVoltStruct *) pvParameters;
 	// Get the I2C device pointer
 	vtI2CStruct *devPtr = param->dev;
-	// Get the LCD information pointer
-	vtLCDStruct *lcdData = param->lcdData;
-	// String buffer for printing
-	char lcdBuffer[vtLCDMaxLen+1];
 	// Buffer for receiving messages
 	vtVoltMsg msgBuffer;
 	uint8_t currentState;
-	// I2C Volt message buffer
-	uint8_t data[8];
+	// Everything that is carried from one reading to the next (static to keep it off of the stack)
+	static voltPipe pipe;
+	uint32_t adcSeq;
+	int i;
+	// Set when the set up of the sensor failed: it is sent again at retryAt, without holding up the queue meanwhile
+	uint8_t retryPending = 0;
+	portTickType retryAt = 0;
+	portTickType wait;
+
+	if ((param->streamLen > vtVoltStreamMaxLen) || (param->streamLen % 8 != 0)) {
+		VT_HANDLE_FATAL_ERROR(param->streamLen);
+	}
+
+	memset(&pipe,0,sizeof(pipe));
+	pipe.rateStart = portGET_RUN_TIME_COUNTER_VALUE();
 
 	// Assumes that the I2C device (and thread) have already been initialized
 
 	// This task is implemented as a Finite State Machine.  The incoming messages are examined to see
 	//   whether or not the state should change.
 	//
-	// Temperature sensor configuration sequence (DS1621) Address 0x4F
-	if (vtI2CEnQ(devPtr,vtI2CMsgTypeVoltInit,0x4F,sizeof(i2cCmdInit),i2cCmdInit,0) != pdTRUE) {
-		VT_HANDLE_FATAL_ERROR(0);
+	if (param->adc != NULL) {
+		// The samples come from the on-chip ADC, so there is nothing to set up on the I2C bus
+		while (!(param->adc->channels & (1 << pipe.adcChannel))) pipe.adcChannel++;
+		currentState = fsmStateVoltRead;
+		if (vtADCStart(param->adc,voltADCNotify,param) != pdTRUE) {
+			VT_HANDLE_FATAL_ERROR(0);
+		}
+	} else {
+		// Temperature sensor configuration sequence (DS1621) Address 0x4F (see vtSensorVolt)
+		if (vtI2CEnQProgram(devPtr,vtI2CMsgTypeVoltInit,voltSlvAddr,voltProgInit,voltI2CDone,param) != pdTRUE) {
+			VT_HANDLE_FATAL_ERROR(0);
+		}
+		currentState = fsmStateInitSent;
 	}
-	currentState = fsmStateInitSent;
 
 	// Like all good tasks, this should never exit
 	for(;;)
 	{
-		// Wait for a message from either a timer or from an I2C operation
-		if (xQueueReceive(param->inQ,(void *) &msgBuffer,portMAX_DELAY) != pdTRUE) {
-			VT_HANDLE_FATAL_ERROR(0);
-		}
-
-		// Now, based on the type of the message and the state, we decide on the new state and action to take
-		switch(getMsgType(&msgBuffer)) {
-
-			// Receive Acknowledge
-			case vtI2CMsgTypeVoltInit: {
-				if (currentState == fsmStateInitSent) {
-					currentState = fsmStateVoltRead;
-				} else {
-					// unexpectedly received this message
+		// Wait for a message from either a timer or from an I2C operation (or until the set up is to be tried again)
+		wait = portMAX_DELAY;
+		if (retryPending) {
+			wait = retryAt - xTaskGetTickCount();
+			if ((wait == 0) || (wait > voltInitRetry)) {
+				// it is due (or overdue, and the subtraction wrapped)
+				retryPending = 0;
+				wait = portMAX_DELAY;
+				if (vtI2CEnQProgram(devPtr,vtI2CMsgTypeVoltInit,voltSlvAddr,voltProgInit,voltI2CDone,param) != pdTRUE) {
 					VT_HANDLE_FATAL_ERROR(0);
 				}
-				break;
 			}
+		}
+		if (xQueueReceive(param->inQ,(void *) &msgBuffer,wait) != pdTRUE) {
+			if (!retryPending) {
+				VT_HANDLE_FATAL_ERROR(0);
+			}
+			// the set up is due, and is sent at the top of the loop
+			continue;
+		}
+		// ...and then take whatever else is already waiting without blocking, so that the readings that piled up while we
+		//   were not running go on to the LCD as one block (one wakeup for all of them instead of one each)
+		pipe.blockCount = 0;
+		do {
+			if (msgBuffer.status != vtI2CStatusOk) {
+				// The sensor did not answer (or the bus was lost, or it timed out), so there is no reading in this
+				param->errors++;
+				if (getMsgType(&msgBuffer) == vtI2CMsgTypeVoltInit) {
+					// it was not set up either, so try again after a while -- the rest of the queue is still taken
+					//   meanwhile (never sleep in here, that would leave the readings and the ADC buffers waiting)
+					retryPending = 1;
+					retryAt = xTaskGetTickCount() + voltInitRetry;
+				}
+				continue;
+			}
+			// Now, based on the type of the message and the state, we decide on the new state and action to take
+			switch(getMsgType(&msgBuffer)) {
 
-			// Send Volt Requests
-			case VoltMsgTypeTimer: {
-				// Timer messages never change the state, they just cause an action (or not) 
-				if (currentState != fsmStateInitSent) {
-					if (vtI2CEnQ(devPtr,vtI2CMsgTypeVoltRead,0x4F,sizeof(i2cCmdRead1Vals),i2cCmdRead1Vals,8) != pdTRUE) {
+				// Receive Acknowledge
+				case vtI2CMsgTypeVoltInit: {
+					if (currentState == fsmStateInitSent) {
+						currentState = fsmStateVoltRead;
+						// From now on, the sensor is read without this task and only the results come back here -- either
+						//   the I2C task runs the read every period, or a hardware timer interrupt starts each one (which
+						//   keeps the samples evenly spaced no matter what the other tasks are doing)
+						param->poll.msgType = vtI2CMsgTypeVoltRead;
+						param->poll.slvAddr = voltSlvAddr;
+						param->poll.txLen = sizeof(i2cCmdRead1Vals);
+						memcpy(param->poll.txBuf,i2cCmdRead1Vals,sizeof(i2cCmdRead1Vals));
+						param->poll.rxLen = 8;
+						param->poll.period = voltPollPeriod;
+						param->poll.priority = param->hwPaced ? vtI2CPrioHigh : vtI2CPrioNormal;
+						param->poll.replyQ = NULL;
+						param->poll.callback = voltI2CDone;
+						param->poll.cbArg = param;
+						if (param->streamLen != 0) {
+							// The sensor is already converting continuously (see voltProgInit), so just read back-to-back
+							param->poll.rxLen = param->streamLen;
+							param->poll.period = 0;
+							param->poll.priority = vtI2CPrioNormal;
+							if (vtI2CPollStart(devPtr,&(param->poll)) != pdTRUE) {
+								VT_HANDLE_FATAL_ERROR(0);
+							}
+						} else if (param->hwPaced) {
+							startHwTimerForVoltage(param,voltPollPeriodUs);
+						} else if (vtI2CPollStart(devPtr,&(param->poll)) != pdTRUE) {
+							VT_HANDLE_FATAL_ERROR(0);
+						}
+					} else {
+						// unexpectedly received this message
 						VT_HANDLE_FATAL_ERROR(0);
 					}
-				} else {
-					// just ignore timer messages until initialization is complete
-				} 
-				break;
-			}
+					break;
+				}
 
-			// Get Volt Data
-			case vtI2CMsgTypeVoltRead: {
-				if (currentState == fsmStateVoltRead) {
-					getValue(data,&msgBuffer,8);
-					if (lcdData != NULL) {
-						if (SendLCDGraphMsg(lcdData,data,portMAX_DELAY) != pdTRUE) {
+				// Send Volt Requests (only if someone has started a timer for this -- the poll job above normally does it)
+				case VoltMsgTypeTimer: {
+					// Timer messages never change the state, they just cause an action (or not) 
+					if (currentState != fsmStateInitSent) {
+						if (vtI2CEnQCallback(devPtr,vtI2CMsgTypeVoltRead,voltSlvAddr,sizeof(i2cCmdRead1Vals),i2cCmdRead1Vals,8,voltI2CDone,param) != pdTRUE) {
 							VT_HANDLE_FATAL_ERROR(0);
 						}
+					} else {
+						// just ignore timer messages until initialization is complete
+					} 
+					break;
+				}
+
+				// Get Volt Data
+				case vtI2CMsgTypeVoltRead: {
+					if (currentState == fsmStateVoltRead) {
+						// 8 values per reading (more than one reading per message when streaming)
+						for (i=0;i+8<=msgBuffer.length;i+=8) {
+							voltAddReading(param,&pipe,&(msgBuffer.buf[i]),msgBuffer.stamp);
+						}
+						voltShowRate(param,&pipe);
+					} else {
+						// unexpectedly received this message
+						VT_HANDLE_FATAL_ERROR(0);
 					}
-				} else {
-					// unexpectedly received this message
-					VT_HANDLE_FATAL_ERROR(0);
+					break;
 				}
-				break;
-			}
 		
-			// Error
-			default: {
-				VT_HANDLE_FATAL_ERROR(getMsgType(&msgBuffer));
-				break;
+				// The ADC has filled a buffer (see voltADCNotify())
+				case VoltMsgTypeADC: {
+					memcpy(&adcSeq,msgBuffer.buf,sizeof(adcSeq));
+					voltAddADC(param,&pipe,adcSeq,msgBuffer.stamp);
+					voltShowRate(param,&pipe);
+					break;
+				}
+
+				// Error
+				default: {
+					VT_HANDLE_FATAL_ERROR(getMsgType(&msgBuffer));
+					break;
+				}
 			}
-		}
+		} while (xQueueReceive(param->inQ,(void *) &msgBuffer,0) == pdTRUE);
+		voltSendBlock(param,pipe.block,pipe.blockCount,pipe.samples,pipe.stamp);
 	}
 }
 
@@ -1,17 +1,51 @@
 #ifndef I2CTEMP_TASK_H
 #define I2CTEMP_TASK_H
 #include "vtI2C.h"
+#include "vtI2CSlave.h"
 #include "lcdTask.h"
+#include "voltFilter.h"
+#include "sampleRing.h"
+#include "trigger.h"
+#include "voltStats.h"
+#include "adcSampler.h"
 // Structure used to pass parameters to the task
 // Do not touch...
 typedef struct __VoltStruct {
 	vtI2CStruct *dev;
 	vtLCDStruct *lcdData;
 	xQueueHandle inQ;
+	vtI2CPollJob poll;	// The periodic read of the sensor that is run by the I2C task
+	vtI2CSlave *slave;	// If not NULL, each reading is published here for an external master (set before starting the task)
+	uint8_t hwPaced;	// If 1, the readings are started by a hardware timer interrupt instead of by the I2C task (set before starting the task)
+	uint8_t streamLen;	// If not 0, stream: the sensor is read as fast as the bus allows, this many bytes at a time (a multiple of 8,
+						//   up to vtVoltStreamMaxLen), instead of 8 bytes every period (set before starting the task; hwPaced is ignored)
+	vtVoltFilter *filter;	// If not NULL, the readings go through this (set up with vtVoltFilterInit()) on their way to the
+							//   LCD and the external master, which then get 1/decim as many (set before starting the task)
+	vtSampleRing *ring;		// If not NULL, the readings are put in here for whoever wants them, and are not sent to the LCD
+							//   (which should then be reading this ring) (set before starting the task)
+	vtTrigger *trig;		// If not NULL, every reading (before any filtering) goes through this (set before starting the task)
+	vtStats *stats;			// If not NULL, every reading (before any filtering) is added to these (set before starting the task)
+	vtADCStruct *adc;		// If not NULL, the readings come from the on-chip ADC (set up with vtADCInit()) instead of the sensor: the
+							//   lowest of its channels, 8 bits, 8 values per reading (set before starting the task; the I2C settings
+							//   above are then ignored)
+	uint32_t adcMissed;		// ADC buffers that were never looked at because the queue to the task was full
+	uint32_t adcLapped;		// ADC buffers that the DMA started to write over before the task was done with them
+	uint32_t dropped;		// Results of I2C operations lost because the queue to the task was full
+	uint32_t errors;		// Reads (and set ups) of the sensor that failed on the bus
 } vtVoltStruct;
-// Maximum length of a message that can be received by this task
+// Longest read of the sensor when streaming (see streamLen) -- every message to this task has room for this many bytes,
+//   so leave it at 0 unless streaming is used
+#define vtVoltStreamMaxLen 0
+#if vtVoltStreamMaxLen > vtI2CMLen
+vtVoltStreamMaxLen cannot be longer than vtI2CMLen
+#endif
+// Maximum length of a message that can be received by this task (one reading, unless streaming needs more)
 //#define vtVoltMaxLen   (sizeof(portTickType))
+#if vtVoltStreamMaxLen > 8
+#define vtVoltMaxLen vtVoltStreamMaxLen
+#else
 #define vtVoltMaxLen 8
+#endif
 
 // Public API
 //
@@ -41,4 +75,21 @@ portBASE_TYPE SendVoltTimerMsg(vtVoltStruct *voltData,portTickType ticksElapsed,
 // Return:
 //   Result of the call to xQueueSend()
 portBASE_TYPE SendVoltValueMsg(vtVoltStruct *voltData,uint8_t msgType,uint8_t *value,uint8_t size,portTickType ticksToBlock);
+//
+// The same as SendVoltValueMsg(), for a value that was sampled at a known time
+// Args (in addition to those of SendVoltValueMsg())
+//   stamp -- run time counter value (portGET_RUN_TIME_COUNTER_VALUE()) at which the sample was taken
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE SendVoltSampleMsg(vtVoltStruct *voltData,uint8_t msgType,uint8_t *value,uint8_t size,uint32_t stamp,portTickType ticksToBlock);
+//
+// Send the result of an I2C operation to the Temperature task, as it came back from the I2C task (with its status, so
+//   that a read that failed is not taken as a reading)
+// Args:
+//   voltData -- a pointer to a variable of type vtVoltStruct
+//   msg -- the completed descriptor (msgType, rxBuf/rxLen, status and tEnq, the time of the sample, are used)
+//   ticksToBlock -- how long the routine should wait if the queue is full
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE SendVoltResultMsg(vtVoltStruct *voltData,vtI2CMsg *msg,portTickType ticksToBlock);
 #endif
\ No newline at end of file
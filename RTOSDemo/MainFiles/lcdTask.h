@@ -2,6 +2,10 @@
 #define LCD_TASK_H
 #include "queue.h"
 #include "timers.h"
+#include "sampleRing.h"
+#include "trigger.h"
+#include "voltStats.h"
+#include "voltFFT.h"
 
 // NOTE: This is a reasonable API definition file because there is nothing in it that the
 //   user of the API does not need (e.g., no private definitions) and it defines the *only*
@@ -13,11 +17,21 @@
 //   pass the structure as an argument to the API calls
 typedef struct __vtLCDStruct {
 	xQueueHandle inQ;					   	// Queue used to send messages from other tasks to the LCD task to print
+	vtSampleRing *ring;						// If not NULL, the readings in here are graphed on every timer message
+											//   (set before starting the task)
+	vtTrigger *trig;						// If not NULL, its latest capture is shown instead of the rolling graph once
+											//   there is one (set before starting the task)
+	vtStats *stats;							// If not NULL, its sliding window is shown at the top of the graph on every
+											//   timer message (set before starting the task)
+	vtFFT *fft;								// If not NULL, the readings from the ring go into this too, and their spectrum
+											//   is shown instead of the graph on every timer message (set before starting the task)
 } vtLCDStruct;
 
 // Structure used to define the messages that are sent to the LCD thread
 //   the maximum length of a message to be printed is the size of the "buf" field below
 #define vtLCDMaxLen 20
+// Most samples (of 8 values each) in one message sent with SendLCDGraphBlockMsg()
+#define vtLCDMaxBlock 4
 
 /* ********************************************************************* */
 // The following are the public API calls that other tasks should use to work with the LCD task
@@ -48,6 +62,16 @@ portBASE_TYPE SendLCDTimerMsg(vtLCDStruct *lcdData,portTickType ticksElapsed,por
 //   Result of the call to xQueueSend()
 portBASE_TYPE SendLCDPrintMsg(vtLCDStruct *lcdData,int length,char *pString,portTickType ticksToBlock);
 portBASE_TYPE SendLCDGraphMsg(vtLCDStruct *lcdData,uint8_t *data,portTickType ticksToBlock);
+// Send a block of samples to graph in one message (the same as count calls to SendLCDGraphMsg(), but with one queue
+//   operation and one wakeup of the LCD task)
+// Args:
+//   lcdData -- a pointer to a variable of type vtLCDStruct
+//   data -- count samples of 8 values each, one after the other
+//   count -- number of samples -- the call will result in a fatal error if it is more than vtLCDMaxBlock
+//   ticksToBlock -- how long the routine should wait if the queue is full
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE SendLCDGraphBlockMsg(vtLCDStruct *lcdData,uint8_t *data,uint8_t count,portTickType ticksToBlock);
 /* ********************************************************************* */
 
 
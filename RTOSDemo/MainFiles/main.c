@@ -94,6 +94,84 @@ You should read the note above.
 // Define whether to use my temperature sensor read task (the sensor is on the PIC v4 demo board, so if that isn't connected
 //   then this should be off
 #define USE_MTJ_V4Temp_Sensor 1
+// Define whether to use the conductor task -- the sensor task gets its I2C results directly, so the conductor is only
+//   needed to route results of I2C operations that were sent without a completion target (see vtI2CEnQ())
+#define USE_CONDUCTOR 0
+// Define whether to start the other two I2C peripherals (each gets its own task, so all three buses run in parallel)
+#define USE_I2C1 0
+#define USE_I2C2 0
+// Define whether to let an external I2C master read the latest sensor data from us (I2C1 in slave mode, see vtI2CSlave.h)
+#define USE_I2C_SLAVE 0
+#if USE_I2C_SLAVE == 1 && USE_I2C1 == 1
+I2C1 cannot be both a master and a slave
+#endif
+// Define whether to watch the sensor's bus with I2C2 in monitor mode (its pins wired onto the I2C0 bus, see vtI2CSniff.h);
+//   the events go out on ITM port vtITMPortI2CSniff
+#define USE_I2C_SNIFF 0
+#if USE_I2C_SNIFF == 1 && USE_I2C2 == 1
+I2C2 cannot be both a master and a sniffer
+#endif
+// Define whether each reading of the sensor is started by a hardware timer interrupt (TIMER1) instead of by the I2C task
+//   -- the samples are then evenly spaced no matter how busy the other tasks are
+#define USE_HW_SAMPLE_TIMER 0
+// Define how many bytes to read from the sensor at a time to stream it (as fast as the bus allows) -- 0 for one reading
+//   every sample period; otherwise a multiple of 8, up to vtVoltStreamMaxLen in i2cVolt.h, which has to be raised to
+//   match (USE_HW_SAMPLE_TIMER is then ignored)
+#define VOLT_STREAM_LEN 0
+// Define whether the sensor readings are filtered before they are shown (and what filter, see voltFilter.h)
+#define USE_VOLT_FILTER 0
+#define VOLT_FILTER_KIND vtVoltFilterAvg
+#define VOLT_FILTER_DECIM 1
+#define VOLT_FILTER_LEN 4
+// Define whether the sensor readings are put in a ring that the LCD (and anything else) reads from, instead of being
+//   sent to the LCD in messages (see sampleRing.h)
+#define USE_SAMPLE_RING 0
+#if USE_SAMPLE_RING == 1 && (USE_MTJ_LCD == 0 || USE_MTJ_V4Temp_Sensor == 0)
+The sample ring needs both the LCD and the sensor
+#endif
+// Define whether the LCD shows what the trigger caught (see trigger.h) instead of the rolling graph once it has caught
+//   something, and what it triggers on
+#define USE_TRIGGER 0
+#define TRIGGER_KIND vtTriggerRising
+#define TRIGGER_LEVEL 128
+#define TRIGGER_HYST 4
+#define TRIGGER_PRE 76
+#define TRIGGER_POST 76
+#if USE_TRIGGER == 1 && (USE_MTJ_LCD == 0 || USE_MTJ_V4Temp_Sensor == 0)
+The trigger needs both the LCD and the sensor
+#endif
+// Define whether running statistics are kept on the sensor readings (shown on the LCD, and in the slave register map),
+//   and over how many values (see voltStats.h)
+#define USE_VOLT_STATS 0
+#define VOLT_STATS_SLIDE 128
+#define VOLT_STATS_TUMBLE 2048
+#if USE_VOLT_STATS == 1 && (USE_MTJ_LCD == 0 || USE_MTJ_V4Temp_Sensor == 0)
+The statistics need both the LCD and the sensor
+#endif
+// Define whether the LCD shows the spectrum of the sensor readings (see voltFFT.h) instead of the graph, and over how many
+//   of them (a power of 2, 64 to 512)
+#define USE_VOLT_FFT 0
+#define VOLT_FFT_LEN 256
+#if USE_VOLT_FFT == 1 && USE_SAMPLE_RING == 0
+The spectrum is worked out from the sample ring
+#endif
+// Define whether the sensor task takes its readings from the on-chip ADC instead of the sensor on I2C (see adcSampler.h),
+//   which channels are converted (bit n for AD0.n -- AD0.2 is the potentiometer on the MCB1700; the task uses the lowest
+//   one), how many conversions per second at most (over all of them -- see vtADCInit() for the rate it really runs at),
+//   and which GPDMA channel copies them out
+#define USE_ADC_SOURCE 0
+#define ADC_CHANNELS (1 << 2)
+#define ADC_RATE 200000
+#define ADC_DMA_CHANNEL 0
+#if USE_ADC_SOURCE == 1 && USE_MTJ_V4Temp_Sensor == 0
+The ADC is read by the sensor task
+#endif
+// Define whether to start the acquisition task that serves any other I2C sensors from their descriptors (see sensorTask.h
+//   and sensorDrivers.h) -- they are put on whichever of the started I2C peripherals has the least load
+#define USE_SENSOR_TASK 0
+#if USE_SENSOR_TASK == 1 && USE_MTJ_V4Temp_Sensor == 0
+The acquisition task needs I2C0, which is started along with the sensor task
+#endif
 // Define whether to use my USB task
 #define USE_MTJ_USE_USB 0
 // Define whether to use my web server task
@@ -122,8 +200,12 @@ You should read the note above.
 #include "lcdTask.h"
 #include "i2cVolt.h"
 #include "vtI2C.h"
+#include "vtI2CSlave.h"
+#include "vtI2CSniff.h"
 #include "myTimers.h"
 #include "conductor.h"
+#include "sensorTask.h"
+#include "sensorDrivers.h"
 #include "vtUART.h"
 
 /* syscalls initialization -- *must* occur first */
@@ -148,9 +230,16 @@ tick hook). */
 #define mainLCD_TASK_PRIORITY				( tskIDLE_PRIORITY)
 #define mainI2CTEMP_TASK_PRIORITY			( tskIDLE_PRIORITY)
 #define mainUSB_TASK_PRIORITY				( tskIDLE_PRIORITY)
-#define mainI2CMONITOR_TASK_PRIORITY		( tskIDLE_PRIORITY)
+// The I2C tasks spend nearly all of their time blocked, and when a transaction comes in, it should go on the bus right
+//   away rather than wait for the LCD (or anything else) to finish
+#define mainI2CMONITOR_TASK_PRIORITY		( tskIDLE_PRIORITY + 1)
 #define mainCONDUCTOR_TASK_PRIORITY			( tskIDLE_PRIORITY)
+#define mainSENSOR_TASK_PRIORITY			( tskIDLE_PRIORITY)
 #define mainUARTMONITOR_TASK_PRIORITY		( tskIDLE_PRIORITY)
+#define mainI2CSNIFF_TASK_PRIORITY			( tskIDLE_PRIORITY)
+
+/* Bus load (bytes per second) of the voltage sensor: address + command, address + 8 bytes every 32ms */
+#define mainVOLT_I2C_LOAD					( ( 2 + 9 ) * 1000 / 32 )
 
 /* The WEB server has a larger stack as it utilises stack hungry string
 handling library calls. */
@@ -167,6 +256,20 @@ without an error being reported. */
  */
 static void prvSetupHardware( void );
 
+#if USE_SENSOR_TASK == 1
+/*
+ * Where the samples of the acquisition task go.
+ */
+static void sensorSink(const vtSensorDesc *desc,const vtSensorSample *sample,void *arg);
+#endif
+
+#if USE_I2C_SNIFF == 1
+/*
+ * Where the events seen by the bus sniffer go.
+ */
+static void sniffToITM(const vtI2CSniffEvent *ev,uint16_t count,void *arg);
+#endif
+
 /*
  * The task that handles the uIP stack.  All TCP/IP processing is performed in
  * this task.
@@ -189,14 +292,60 @@ char *pcGetTaskStatusMessage( void );
 static char *pcStatusMessage = mainPASS_STATUS_MESSAGE;
 
 
+#if USE_I2C_SLAVE == 1
+static vtI2CSlave i2cSlave;
+#endif
+#if USE_I2C_SNIFF == 1
+static vtI2CSniff i2cSniff;
+#endif
+#if USE_I2C1 == 1
+static vtI2CStruct vtI2C1;
+#endif
+#if USE_I2C2 == 1
+static vtI2CStruct vtI2C2;
+#endif
+
 #if USE_MTJ_V4Temp_Sensor == 1
 // data structure required for one I2C task
 static vtI2CStruct vtI2C0;
 // data structure required for one temperature sensor task
 static vtVoltStruct voltSensorData;
+#if USE_VOLT_FILTER == 1
+// the filter that its readings go through
+static vtVoltFilter voltFilter;
+#endif
+#if USE_SAMPLE_RING == 1
+// where its readings go for the LCD (and any other reader)
+static vtSampleRing voltRing;
+#endif
+#if USE_TRIGGER == 1
+// what catches short events in its readings for the LCD
+static vtTrigger voltTrigger;
+#endif
+#if USE_VOLT_STATS == 1
+// statistics of its readings
+static vtStats voltStats;
+#endif
+#if USE_VOLT_FFT == 1
+// the spectrum of its readings for the LCD
+static vtFFT voltFFT;
+#endif
+#if USE_ADC_SOURCE == 1
+// where its readings come from instead of the sensor
+static vtADCStruct voltADC;
+#endif
+#if USE_CONDUCTOR == 1
 // data structure required for conductor task
 static vtConductorStruct conductorData;
 #endif
+#endif
+
+#if USE_SENSOR_TASK == 1
+// data structure required for the acquisition task
+static vtSensorStruct sensorData;
+// the latest sample of each of its sensors (see sensorSink())
+static vtSensorSample sensorLatest[vtSensorMaxDevs];
+#endif
 
 #if USE_UART == 1
 static UART_CFG_Type uartCfg;
@@ -243,6 +392,32 @@ int main( void )
     xTaskCreate( vuIP_Task, ( signed char * ) "uIP", mainBASIC_WEB_STACK_SIZE, ( void * ) NULL, mainUIP_TASK_PRIORITY, NULL );
 	#endif
 
+	#if USE_SAMPLE_RING == 1
+	vtSampleRingInit(&voltRing);
+	vtLCDdata.ring = &voltRing;
+	voltSensorData.ring = &voltRing;
+	#endif
+	#if USE_TRIGGER == 1
+	if (vtTriggerInit(&voltTrigger,TRIGGER_KIND,TRIGGER_LEVEL,TRIGGER_HYST,TRIGGER_PRE,TRIGGER_POST) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	vtLCDdata.trig = &voltTrigger;
+	voltSensorData.trig = &voltTrigger;
+	#endif
+	#if USE_VOLT_STATS == 1
+	if (vtStatsInit(&voltStats,VOLT_STATS_SLIDE,VOLT_STATS_TUMBLE) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	vtLCDdata.stats = &voltStats;
+	voltSensorData.stats = &voltStats;
+	#endif
+	#if USE_VOLT_FFT == 1
+	if (vtFFTInit(&voltFFT,VOLT_FFT_LEN) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	vtLCDdata.fft = &voltFFT;
+	#endif
+
 	#if USE_MTJ_LCD == 1
 	// MTJ: My LCD demonstration task
 	StartLCDTask(&vtLCDdata,mainLCD_TASK_PRIORITY);
@@ -260,18 +435,74 @@ int main( void )
 	if (vtI2CInit(&vtI2C0,0,mainI2CMONITOR_TASK_PRIORITY,100000) != vtI2CInitSuccess) {
 		VT_HANDLE_FATAL_ERROR(0);
 	}
+	// The sensor is wired to I2C0; record it so that vtI2CPlaceDevice() will put other polled devices elsewhere
+	if (vtI2CReserveDevice(&vtI2C0,0x4F,mainVOLT_I2C_LOAD) != vtI2CPlaceSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
 
+	#if USE_I2C_SLAVE == 1
+	// Answer an external master at address 0x30 with the latest readings (the sensor task publishes them)
+	if (vtI2CSlaveInit(&i2cSlave,1,0x30) != vtI2CInitSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	voltSensorData.slave = &i2cSlave;
+	#endif
+	#if USE_HW_SAMPLE_TIMER == 1
+	voltSensorData.hwPaced = 1;
+	#endif
+	#if VOLT_STREAM_LEN > vtVoltStreamMaxLen
+	VOLT_STREAM_LEN is longer than vtVoltStreamMaxLen (see i2cVolt.h)
+	#endif
+	voltSensorData.streamLen = VOLT_STREAM_LEN;
+	#if USE_VOLT_FILTER == 1
+	if (vtVoltFilterInit(&voltFilter,VOLT_FILTER_KIND,VOLT_FILTER_DECIM,VOLT_FILTER_LEN,vtVoltFilterLowPass) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	voltSensorData.filter = &voltFilter;
+	#endif
+	#if USE_ADC_SOURCE == 1
+	if (vtADCInit(&voltADC,ADC_CHANNELS,ADC_RATE,ADC_DMA_CHANNEL) != vtADCInitSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	voltSensorData.adc = &voltADC;
+	#endif
 	// Now, start up the task that is going to handle the temperature sensor sampling (it will talk to the I2C task and LCD task using their APIs)
 	#if USE_MTJ_LCD == 1
 	vStarti2cVoltTask(&voltSensorData,mainI2CTEMP_TASK_PRIORITY,&vtI2C0,&vtLCDdata);
 	#else
 	vStarti2cVoltTask(&voltSensorData,mainI2CTEMP_TASK_PRIORITY,&vtI2C0,NULL);
 	#endif
-	// Here we set up a timer that will send messages to the Temperature sensing task.  The timer will determine how often the sensor is sampled
-	startTimerForVoltage(&voltSensorData);
+	// The sensor is sampled by a poll job that the sensor task hands to the I2C task, so no timer is needed for it
+	//   (startTimerForVoltage() would still work for sending extra read requests through the sensor task)
+	#if USE_CONDUCTOR == 1
 	// start up a "conductor" task that will move messages around
 	vStartConductorTask(&conductorData,mainCONDUCTOR_TASK_PRIORITY,&vtI2C0,&voltSensorData);
 	#endif
+	#endif
+
+	#if USE_I2C1 == 1
+	if (vtI2CInit(&vtI2C1,1,mainI2CMONITOR_TASK_PRIORITY,100000) != vtI2CInitSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	#endif
+	#if USE_I2C2 == 1
+	if (vtI2CInit(&vtI2C2,2,mainI2CMONITOR_TASK_PRIORITY,100000) != vtI2CInitSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	#endif
+	#if USE_I2C_SNIFF == 1
+	if (vtI2CSniffInit(&i2cSniff,2,mainI2CSNIFF_TASK_PRIORITY,sniffToITM,NULL) != vtI2CInitSuccess) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	#endif
+
+	#if USE_SENSOR_TASK == 1
+	// Once all of the I2C peripherals are started, so that the sensors can be spread across them
+	if (vtSensorAdd(&sensorData,&vtSensorDS1621,NULL) < 0) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	vStartSensorTask(&sensorData,mainSENSOR_TASK_PRIORITY,sensorSink,sensorLatest);
+	#endif
 
 	#if USE_UART == 1
 	UART_ConfigStructInit(&uartCfg);
@@ -298,6 +529,30 @@ int main( void )
 }
 /*-----------------------------------------------------------*/
 
+#if USE_SENSOR_TASK == 1
+// Where the samples of the acquisition task go -- here, they are just kept for whoever wants to look at them
+static void sensorSink(const vtSensorDesc *desc,const vtSensorSample *sample,void *arg)
+{
+	vtSensorSample *latest = (vtSensorSample *) arg;
+
+	latest[sample->sensor] = *sample;
+}
+#endif
+
+#if USE_I2C_SNIFF == 1
+// Where the events seen by the bus sniffer go -- each one is written to ITM as it is (ts in the low 16 bits, then kind,
+//   then data), a batch at a time, for the trace window (or a host tool) to decode
+static void sniffToITM(const vtI2CSniffEvent *ev,uint16_t count,void *arg)
+{
+	uint16_t i;
+
+	for (i=0;i<count;i++,ev++) {
+		vtITMu32(vtITMPortI2CSniff,((uint32_t) ev->data << 24) | ((uint32_t) ev->kind << 16) | ev->ts);
+	}
+}
+#endif
+/*-----------------------------------------------------------*/
+
 void vApplicationTickHook( void )
 {
 static unsigned long ulTicksSinceLastDisplay = 0;
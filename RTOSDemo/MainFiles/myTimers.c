@@ -8,6 +8,7 @@
 #include "vtUtilities.h"
 #include "LCDtask.h"
 #include "myTimers.h"
+#include "lpc17xx_timer.h"
 
 /* **************************************************************** */
 // WARNING: Do not print in this file -- the stack is not large enough for this task
@@ -95,4 +96,48 @@ void startTimerForVoltage(vtVoltStruct *vtVoltdata) {
 			VT_HANDLE_FATAL_ERROR(0);
 		}
 	}
-}
\ No newline at end of file
+}
+
+/* *********************************************************** */
+// Hardware timer for the sensor readings
+//
+// A software timer goes through the timer task, so how late it is depends on every other task; instead, TIMER1 (counting
+//   microseconds) interrupts every period and the interrupt handler puts the read straight on the I2C task's queue
+// Must be at or below configMAX_SYSCALL_INTERRUPT_PRIORITY (the handler uses the FreeRTOS API); above the I2C interrupts
+#define hwTimerIntPriority 6
+static vtVoltStruct *hwVoltData;
+
+void TIMER1_IRQHandler(void)
+{
+	static signed portBASE_TYPE xHigherPriorityTaskWoken;
+
+	TIM_ClearIntPending(LPC_TIM1,TIM_MR0_INT);
+	xHigherPriorityTaskWoken = pdFALSE;
+	// If the I2C task has fallen behind, this sample is skipped (and counted in the missed field of the poll job)
+	vtI2CPollFromISR(hwVoltData->dev,&(hwVoltData->poll),&xHigherPriorityTaskWoken);
+	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+void startHwTimerForVoltage(vtVoltStruct *vtVoltdata,uint32_t periodUs) {
+	TIM_TIMERCFG_Type timerCfg;
+	TIM_MATCHCFG_Type matchCfg;
+
+	if ((vtVoltdata == NULL) || (periodUs == 0)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	hwVoltData = vtVoltdata;
+	timerCfg.PrescaleOption = TIM_PRESCALE_USVAL;
+	timerCfg.PrescaleValue = 1;
+	TIM_Init(LPC_TIM1,TIM_TIMER_MODE,&timerCfg);
+	// Interrupt and start over on match 0 (the counter goes from 0 to MR0, so that is periodUs counts)
+	matchCfg.MatchChannel = 0;
+	matchCfg.IntOnMatch = ENABLE;
+	matchCfg.StopOnMatch = DISABLE;
+	matchCfg.ResetOnMatch = ENABLE;
+	matchCfg.ExtMatchOutputType = TIM_EXTMATCH_NOTHING;
+	matchCfg.MatchValue = periodUs - 1;
+	TIM_ConfigMatch(LPC_TIM1,&matchCfg);
+	NVIC_SetPriority(TIMER1_IRQn,hwTimerIntPriority);
+	NVIC_EnableIRQ(TIMER1_IRQn);
+	TIM_Cmd(LPC_TIM1,ENABLE);
+}
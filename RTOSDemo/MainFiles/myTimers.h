@@ -4,4 +4,7 @@
 #include "i2cVolt.h"
 void startTimerForLCD(vtLCDStruct *vtLCDdata);
 void startTimerForVoltage(vtVoltStruct *vtVoltdata);
+// Start TIMER1 interrupting every periodUs microseconds, each time putting the read of the poll job of the sensor task
+//   straight on the I2C task's queue (see vtI2CPollFromISR())
+void startHwTimerForVoltage(vtVoltStruct *vtVoltdata,uint32_t periodUs);
 #endif
\ No newline at end of file
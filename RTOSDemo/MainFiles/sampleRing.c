@@ -0,0 +1,79 @@
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "sampleRing.h"
+
+/* *********************************************** */
+// definitions that are private to this file
+#if (vtSampleRingLen & (vtSampleRingLen-1))
+vtSampleRingLen must be a power of 2
+#endif
+#define vtSampleRingMask (vtSampleRingLen-1)
+// end of defs
+/* *********************************************** */
+
+/*-----------------------------------------------------------*/
+// Public API
+void vtSampleRingInit(vtSampleRing *ring)
+{
+	memset(ring,0,sizeof(vtSampleRing));
+}
+
+void vtSampleRingPut(vtSampleRing *ring,const uint8_t *data,uint32_t stamp)
+{
+	uint32_t n = ring->head;
+	vtSample *s = (vtSample *) &(ring->slot[n & vtSampleRingMask].sample);
+
+	// Mark the slot as being written before touching it, and only give it its new number (and move head on) once
+	//   it is all there
+	ring->slot[n & vtSampleRingMask].seq = 0;
+	__DMB();
+	s->stamp = stamp;
+	memcpy(s->data,data,vtSampleLen);
+	__DMB();
+	ring->slot[n & vtSampleRingMask].seq = n + 1;
+	__DMB();
+	ring->head = n + 1;
+}
+
+void vtSampleReaderInit(vtSampleReader *rd,vtSampleRing *ring)
+{
+	rd->ring = ring;
+	rd->next = ring->head;
+	rd->overruns = 0;
+}
+
+uint16_t vtSampleRingRead(vtSampleReader *rd,vtSample *out,uint16_t max)
+{
+	vtSampleRing *ring = rd->ring;
+	uint16_t count = 0;
+	uint32_t head, seq;
+
+	while (count < max) {
+		head = ring->head;
+		if (rd->next == head) break;
+		if (head - rd->next > vtSampleRingLen) {
+			// the oldest ones we have not read are gone already
+			rd->overruns += head - rd->next - vtSampleRingLen;
+			rd->next = head - vtSampleRingLen;
+		}
+		seq = ring->slot[rd->next & vtSampleRingMask].seq;
+		__DMB();
+		memcpy(&(out[count]),(vtSample *) &(ring->slot[rd->next & vtSampleRingMask].sample),sizeof(vtSample));
+		__DMB();
+		if ((seq == rd->next + 1) && (ring->slot[rd->next & vtSampleRingMask].seq == seq)) {
+			count++;
+		} else {
+			// the writer came around to this slot while we were copying it
+			rd->overruns++;
+		}
+		rd->next++;
+	}
+	return(count);
+}
+// End of Public API
+/*-----------------------------------------------------------*/
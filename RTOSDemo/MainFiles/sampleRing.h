@@ -0,0 +1,63 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+#include "FreeRTOS.h"
+#include "lpc_types.h"
+// Ring of timestamped sensor readings with one writer and any number of readers
+//   The writer (the sensor task) puts each reading in once, and every reader (LCD, UART export, logging, ...) has its own
+//   cursor and copies out what it wants whenever it likes.  Nothing is locked and the writer never waits: a reader
+//   that falls more than vtSampleRingLen readings behind loses the oldest ones, and finds out from its overrun count.
+//
+//   Each slot carries the number of the reading in it (0 while it is being written), which the reader checks before
+//   and after copying it out -- if the writer got to the slot in between, the copy is thrown away and counted as lost.
+//
+// Number of readings kept (a power of 2)
+#define vtSampleRingLen 64
+// Number of values in one reading
+#define vtSampleLen 8
+
+// One reading
+typedef struct __vtSample {
+	uint32_t stamp;				// Run time counter value at which it was taken
+	uint8_t data[vtSampleLen];
+} vtSample;
+
+typedef struct __vtSampleRing {
+	struct {
+		volatile uint32_t seq;	// Number of the reading in this slot + 1, or 0 while it is being written
+		vtSample sample;
+	} slot[vtSampleRingLen];
+	volatile uint32_t head;		// Number of readings put in so far
+} vtSampleRing;
+
+// One reader's place in the ring -- only that reader touches it
+typedef struct __vtSampleReader {
+	vtSampleRing *ring;
+	uint32_t next;				// Number of the next reading to copy out
+	uint32_t overruns;			// Number of readings lost because the writer got too far ahead
+} vtSampleReader;
+
+// Empty the ring -- before the writer and readers start
+void vtSampleRingInit(vtSampleRing *ring);
+
+// Put one reading in (there must only be one task that calls this)
+// Args:
+//   ring: the ring
+//   data: vtSampleLen values
+//   stamp: run time counter value at which they were taken
+void vtSampleRingPut(vtSampleRing *ring,const uint8_t *data,uint32_t stamp);
+
+// Start reading a ring -- the reader gets only the readings that are put in from now on
+// Args:
+//   rd: the reader
+//   ring: the ring
+void vtSampleReaderInit(vtSampleReader *rd,vtSampleRing *ring);
+
+// Copy out the readings that have come in since the last call (oldest first)
+// Args:
+//   rd: the reader
+//   out: where the readings go
+//   max: room in out
+// Return:
+//   number of readings copied out (call again if it is max -- there may be more)
+uint16_t vtSampleRingRead(vtSampleReader *rd,vtSample *out,uint16_t max);
+#endif
@@ -0,0 +1,73 @@
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtI2C.h"
+#include "sensorTask.h"
+#include "sensorDrivers.h"
+
+/* *********************************************** */
+// Set up of the DS1621 -- the sensor on the PIC v4 demo board answers to the same commands, so both use this
+//
+static const uint8_t ds1621ProgInit[]= {
+	vtI2COpWrite,2,0xAC,0x00,	// configuration: convert continuously
+	vtI2COpDelay,10,			// the configuration is written to EEPROM, which takes up to 10ms
+	vtI2COpWrite,1,0xEE,		// start converting (a conversion takes up to 750ms on the DS1621)
+	vtI2COpEnd
+};
+
+/* *********************************************** */
+// Sensor on the PIC v4 demo board
+//
+static const uint8_t voltProgRead[]= {
+	vtI2COpWrite,1,0xAA,
+	vtI2COpRead,8,
+	vtI2COpEnd
+};
+
+static uint8_t voltDecode(const uint8_t *raw,uint8_t len,int16_t *values)
+{
+	uint8_t i;
+
+	if (len != 8) return(0);
+	for (i=0;i<8;i++) {
+		values[i] = raw[i];
+	}
+	return(8);
+}
+
+const vtSensorDesc vtSensorVolt = {
+	"Volt",
+	0x4F,
+	(2 + 9) * 1000 / 32,		// bytes per second on the bus
+	ds1621ProgInit,
+	voltProgRead,
+	( ( portTickType ) 32 / portTICK_RATE_MS),
+	voltDecode
+};
+
+/* *********************************************** */
+// DS1621 digital thermometer
+//
+static const uint8_t ds1621ProgRead[]= {
+	vtI2COpWrite,1,0xAA,		// read temperature: whole degrees (signed), then the half degree in the top bit
+	vtI2COpRead,2,
+	vtI2COpEnd
+};
+
+static uint8_t ds1621Decode(const uint8_t *raw,uint8_t len,int16_t *values)
+{
+	if (len != 2) return(0);
+	values[0] = ((int16_t) (int8_t) raw[0] * 2) + (raw[1] >> 7);
+	return(1);
+}
+
+const vtSensorDesc vtSensorDS1621 = {
+	"DS1621",
+	0x48,
+	(2 + 3) * 1000 / 1000,		// bytes per second on the bus
+	ds1621ProgInit,
+	ds1621ProgRead,
+	( ( portTickType ) 1000 / portTICK_RATE_MS),
+	ds1621Decode
+};
@@ -0,0 +1,12 @@
+#ifndef SENSOR_DRIVERS_H
+#define SENSOR_DRIVERS_H
+#include "sensorTask.h"
+// Descriptors of the sensors that the acquisition task knows how to talk to (see sensorTask.h)
+//   Adding another kind of sensor only takes its I2C programs, a decode function and a descriptor here.
+//
+// The sensor on the PIC v4 demo board at 0x4F (the one i2cVolt.c reads, with the address and set up program from here):
+//   8 values of 0-255 per sample, every 32ms
+extern const vtSensorDesc vtSensorVolt;
+// DS1621 digital thermometer at 0x48 (address pins all low): 1 value per sample, in half degrees C, every second
+extern const vtSensorDesc vtSensorDS1621;
+#endif
@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "projdefs.h"
+#include "queue.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "vtI2C.h"
+#include "I2CTaskMsgTypes.h"
+#include "sensorTask.h"
+
+/* *********************************************** */
+// definitions and data structures that are private to this file
+// A sensor has at most one program with the I2C task at a time, so the queue to this task can never fill up
+#define vtSensorQLen vtSensorMaxDevs
+// Reads in a row that may fail before a sensor is set up again (it may have lost power)
+#define vtSensorMaxFails 5
+// States of a sensor
+#define vtSensorStateInit 0
+#define vtSensorStateRun 1
+// Is tick "due" at or before tick "now"? (works across the wrap of the tick count)
+#define vtSensorTickReached(now,due) ((int32_t) ((now) - (due)) >= 0)
+
+// actual data structure that is sent in a message
+typedef struct __vtSensorMsg {
+	uint8_t num;		// Number of the sensor
+	uint8_t msgType;	// vtI2CMsgTypeSensorInit or vtI2CMsgTypeSensorRead
+	uint8_t status;		// As in vtI2CMsg
+	uint8_t length;		// Number of bytes read
+	uint32_t stamp;		// Run time counter value at which the program was handed to the I2C task
+	uint8_t buf[vtI2CMLen];
+} vtSensorMsg;
+
+// One stack for all of the sensors -- the decode functions and the sink run on it
+#define baseStack 2
+#if PRINTF_VERSION == 1
+#define sensorSTACK_SIZE		((baseStack+5)*configMINIMAL_STACK_SIZE)
+#else
+#define sensorSTACK_SIZE		(baseStack*configMINIMAL_STACK_SIZE)
+#endif
+// end of defs
+/* *********************************************** */
+
+/* The sensor task. */
+static portTASK_FUNCTION_PROTO( vSensorUpdateTask, pvParameters );
+
+/*-----------------------------------------------------------*/
+// Public API
+int vtSensorAdd(vtSensorStruct *sensors,const vtSensorDesc *desc,vtI2CStruct *bus)
+{
+	vtSensorDev *dev;
+
+	if ((sensors->devCount >= vtSensorMaxDevs) || (desc->readProg == NULL) || (desc->decode == NULL) || (desc->period == 0)) {
+		return(-1);
+	}
+	if (bus == NULL) {
+		if ((bus = vtI2CPlaceDevice(desc->slvAddr,desc->load)) == NULL) {
+			return(-1);
+		}
+	} else if (vtI2CReserveDevice(bus,desc->slvAddr,desc->load) != vtI2CPlaceSuccess) {
+		return(-1);
+	}
+	dev = &(sensors->dev[sensors->devCount]);
+	dev->desc = desc;
+	dev->bus = bus;
+	dev->owner = sensors;
+	dev->num = sensors->devCount;
+	dev->state = (desc->initProg != NULL) ? vtSensorStateInit : vtSensorStateRun;
+	dev->busy = 0;
+	dev->fails = 0;
+	dev->samples = 0;
+	dev->errors = 0;
+	dev->missed = 0;
+	return(sensors->devCount++);
+}
+
+void vStartSensorTask(vtSensorStruct *sensors,unsigned portBASE_TYPE uxPriority,vtSensorSink sink,void *sinkArg)
+{
+	portBASE_TYPE retval;
+
+	// Create the queue that will be used to talk to this task
+	if ((sensors->inQ = xQueueCreate(vtSensorQLen,sizeof(vtSensorMsg))) == NULL) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	sensors->sink = sink;
+	sensors->sinkArg = sinkArg;
+	/* Start the task */
+	if ((retval = xTaskCreate( vSensorUpdateTask, ( signed char * ) "Sensors", sensorSTACK_SIZE, (void *) sensors, uxPriority, ( xTaskHandle * ) NULL )) != pdPASS) {
+		VT_HANDLE_FATAL_ERROR(retval);
+	}
+}
+// End of Public API
+/*-----------------------------------------------------------*/
+
+// Called from the I2C task when a program of one of the sensors completes
+static void sensorI2CDone(vtI2CMsg *msg,void *arg)
+{
+	vtSensorDev *dev = (vtSensorDev *) arg;
+	vtSensorMsg sensorBuffer;
+
+	sensorBuffer.num = dev->num;
+	sensorBuffer.msgType = msg->msgType;
+	sensorBuffer.status = msg->status;
+	sensorBuffer.length = msg->rxLen;
+	sensorBuffer.stamp = msg->tEnq;
+	memcpy(sensorBuffer.buf,msg->rxBuf,msg->rxLen);
+	// Make this non-blocking so that the I2C bus is never held up by this task (there is always room, see vtSensorQLen)
+	if (xQueueSend(dev->owner->inQ,(void *) &sensorBuffer,0) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+}
+
+// Hand the program that is due for a sensor to the I2C task, and work out when the next one is due
+static void sensorStart(vtSensorDev *dev,portTickType now)
+{
+	vtI2CMsg *msgPtr;
+	uint8_t run = (dev->state == vtSensorStateRun);
+
+	if (!run && dev->busy) {
+		// still waiting to hear how the set up went
+		return;
+	}
+	if (dev->busy || ((msgPtr = vtI2CMsgGet(dev->bus,0)) == NULL)) {
+		// the last read is not back yet (or the bus is swamped), so this one is skipped
+		dev->missed++;
+	} else {
+		msgPtr->msgType = run ? vtI2CMsgTypeSensorRead : vtI2CMsgTypeSensorInit;
+		msgPtr->slvAddr = dev->desc->slvAddr;
+		msgPtr->prog = run ? dev->desc->readProg : dev->desc->initProg;
+		msgPtr->callback = sensorI2CDone;
+		msgPtr->cbArg = dev;
+		if (vtI2CMsgSubmit(dev->bus,msgPtr,0) == pdTRUE) {
+			dev->busy = 1;
+		} else {
+			vtI2CMsgRelease(dev->bus,msgPtr);
+			dev->missed++;
+		}
+	}
+	if (!run) {
+		// if the set up fails, it is tried again after a while
+		dev->nextDue = now + vtSensorRetryTicks;
+		return;
+	}
+	// Stay on the original grid so that the samples do not drift, unless we are a full period behind
+	dev->nextDue += dev->desc->period;
+	if (vtSensorTickReached(now,dev->nextDue)) {
+		dev->missed++;
+		dev->nextDue = now + dev->desc->period;
+	}
+}
+
+// A program of a sensor has completed
+static void sensorDone(vtSensorStruct *param,vtSensorMsg *msgBuffer)
+{
+	vtSensorDev *dev;
+	vtSensorSample sample;
+
+	if (msgBuffer->num >= param->devCount) {
+		VT_HANDLE_FATAL_ERROR(msgBuffer->num);
+	}
+	dev = &(param->dev[msgBuffer->num]);
+	dev->busy = 0;
+	if (msgBuffer->status != vtI2CStatusOk) {
+		dev->errors++;
+		if ((msgBuffer->msgType == vtI2CMsgTypeSensorRead) && (dev->desc->initProg != NULL) && (++dev->fails >= vtSensorMaxFails)) {
+			// start over from the set up
+			dev->state = vtSensorStateInit;
+			dev->fails = 0;
+		}
+		return;
+	}
+	dev->fails = 0;
+	switch (msgBuffer->msgType) {
+		case vtI2CMsgTypeSensorInit: {
+			// Set up, so start reading right away
+			dev->state = vtSensorStateRun;
+			dev->nextDue = xTaskGetTickCount();
+			break;
+		}
+		case vtI2CMsgTypeSensorRead: {
+			sample.count = dev->desc->decode(msgBuffer->buf,msgBuffer->length,sample.value);
+			if ((sample.count == 0) || (sample.count > vtSensorMaxValues)) {
+				dev->errors++;
+				break;
+			}
+			sample.sensor = dev->num;
+			sample.seq = dev->samples++;
+			sample.stamp = msgBuffer->stamp;
+			if (param->sink != NULL) {
+				param->sink(dev->desc,&sample,param->sinkArg);
+			}
+			break;
+		}
+		default: {
+			VT_HANDLE_FATAL_ERROR(msgBuffer->msgType);
+			break;
+		}
+	}
+}
+
+// This is the actual task that is run
+static portTASK_FUNCTION( vSensorUpdateTask, pvParameters )
+{
+	// Get the parameters
+	vtSensorStruct *param = (vtSensorStruct *) pvParameters;
+	// Buffer for receiving messages
+	vtSensorMsg msgBuffer;
+	vtSensorDev *dev;
+	portTickType now, wait;
+	int i;
+
+	// Everything is due right away (the sensors that need it are set up first)
+	now = xTaskGetTickCount();
+	for (i=0;i<param->devCount;i++) {
+		param->dev[i].nextDue = now;
+	}
+
+	// Like all good tasks, this should never exit
+	for(;;)
+	{
+		// Start whatever is due, and sleep until the next one is (or until a program completes)
+		now = xTaskGetTickCount();
+		wait = portMAX_DELAY;
+		for (i=0;i<param->devCount;i++) {
+			dev = &(param->dev[i]);
+			if ((dev->state == vtSensorStateInit) && dev->busy) continue;
+			if (vtSensorTickReached(now,dev->nextDue)) {
+				sensorStart(dev,now);
+			}
+			if ((dev->state == vtSensorStateInit) && dev->busy) continue;
+			if ((dev->nextDue - now) < wait) {
+				wait = dev->nextDue - now;
+			}
+		}
+		if (xQueueReceive(param->inQ,(void *) &msgBuffer,wait) == pdTRUE) {
+			sensorDone(param,&msgBuffer);
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef SENSOR_TASK_H
+#define SENSOR_TASK_H
+#include "vtI2C.h"
+// Sensor drivers
+//   Each I2C sensor is described by a const descriptor (see vtSensorDesc): where it is, the I2C program that sets it up,
+//   the I2C program that reads it, how often to read it, and a function that turns the bytes it sends back into values.
+//   All of the sensors that are added are served by one acquisition task, which keeps its own schedule of when each one
+//   is due (one task and one stack for any number of sensors, and no poll job slots of the I2C task are used up).  The
+//   programs are run by the I2C task of the bus that the sensor is on, and the results come back through a callback, so
+//   the acquisition task only wakes up when a read is due or has completed.  Every sample then goes to one sink function
+//   in the same timestamped form, whatever sensor it came from.
+//
+// Most sensors that one acquisition task can serve
+#define vtSensorMaxDevs 12
+// Most values that one sample can have
+#define vtSensorMaxValues 8
+// Ticks to wait before trying again to set up a sensor that did not answer
+#define vtSensorRetryTicks ((portTickType) 1000 / portTICK_RATE_MS)
+
+// Turn the bytes read by the read program into values
+//   raw: the bytes, one read after the other
+//   len: number of bytes
+//   values: where the values go (room for vtSensorMaxValues)
+// Return:
+//   the number of values, or 0 if the bytes do not make sense (the sample is dropped and counted in errors)
+typedef uint8_t (*vtSensorDecode)(const uint8_t *raw,uint8_t len,int16_t *values);
+
+// What there is to know about one kind of sensor (can stay in flash)
+typedef struct __vtSensorDesc {
+	const char *name;
+	uint8_t slvAddr;			// The address of the i2c slave device
+	uint32_t load;				// The load it puts on the bus (see vtI2CPlaceDevice()), if the bus is left to vtSensorAdd()
+	const uint8_t *initProg;	// I2C program that sets it up (see vtI2CEnQProgram()), or NULL if there is nothing to set up
+	const uint8_t *readProg;	// I2C program that reads one sample -- it must not use vtI2COpDeliver
+	portTickType period;		// Ticks between two reads (at least 1)
+	vtSensorDecode decode;
+} vtSensorDesc;
+
+// One sample, in the same form for every sensor
+typedef struct __vtSensorSample {
+	uint8_t sensor;						// Number of the sensor (in the order they were added, from 0)
+	uint8_t count;						// Number of values
+	uint32_t seq;						// Number of the sample (for this sensor, from 0)
+	uint32_t stamp;						// Run time counter value at which the read was handed to the I2C task
+	int16_t value[vtSensorMaxValues];	// In whatever units the decode function of the sensor gives
+} vtSensorSample;
+
+// Where the samples go -- called from the acquisition task, so it must not block for long
+//   desc: the descriptor of the sensor that the sample came from
+//   arg: as given to vStartSensorTask()
+typedef void (*vtSensorSink)(const vtSensorDesc *desc,const vtSensorSample *sample,void *arg);
+
+// One of the sensors being served
+//   The counts can be read by anyone; the rest is used by the acquisition task -- do not touch
+struct __vtSensorStruct;
+typedef struct __vtSensorDev {
+	const vtSensorDesc *desc;
+	vtI2CStruct *bus;
+	struct __vtSensorStruct *owner;
+	uint8_t num;
+	uint8_t state;
+	uint8_t busy;						// A program of this sensor is with the I2C task
+	uint8_t fails;						// Reads in a row that failed
+	portTickType nextDue;				// Tick at which the next program is to be started
+	uint32_t samples;					// Number of samples handed to the sink
+	uint32_t errors;					// Programs that failed, and reads that did not decode
+	uint32_t missed;					// Periods skipped because the previous read was not back yet or no descriptor was free
+} vtSensorDev;
+
+// Structure used to pass parameters to the task
+// Do not touch...
+typedef struct __vtSensorStruct {
+	xQueueHandle inQ;
+	vtSensorSink sink;
+	void *sinkArg;
+	uint8_t devCount;
+	vtSensorDev dev[vtSensorMaxDevs];
+} vtSensorStruct;
+
+// Public API
+//
+// Add a sensor (before the task is started)
+// Args:
+//   sensors: Data structure used by the task (must start out all 0, e.g., a static variable)
+//   desc: descriptor of the sensor -- it must stay around for good
+//   bus: the I2C peripheral that the sensor is on, or NULL to put it on the one with the least load (see vtI2CPlaceDevice())
+// Return:
+//   The number of the sensor (as in vtSensorSample.sensor), or -1 if there is no room for it, no bus could be found, or
+//   the descriptor is missing something
+int vtSensorAdd(vtSensorStruct *sensors,const vtSensorDesc *desc,vtI2CStruct *bus);
+//
+// Start the task (the I2C tasks of the buses must already be started)
+// Args:
+//   sensors: Data structure used by the task
+//   uxPriority -- the priority you want this task to be run at
+//   sink: where the samples go
+//   sinkArg: passed to sink as is
+void vStartSensorTask(vtSensorStruct *sensors,unsigned portBASE_TYPE uxPriority,vtSensorSink sink,void *sinkArg);
+#endif
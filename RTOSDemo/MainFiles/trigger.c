@@ -0,0 +1,113 @@
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "trigger.h"
+
+/* *********************************************** */
+// definitions that are private to this file
+#if (vtTriggerHistLen & (vtTriggerHistLen-1)) || (vtTriggerHistLen < vtTriggerMaxCapture)
+vtTriggerHistLen must be a power of 2, and at least vtTriggerMaxCapture
+#endif
+#define vtTriggerHistMask (vtTriggerHistLen-1)
+// end of defs
+/* *********************************************** */
+
+// Does value x meet the condition?  (also keeps track of whether the next edge is armed)
+static __INLINE uint8_t vtTriggerCheck(vtTrigger *trig,uint8_t x)
+{
+	switch (trig->kind) {
+		case vtTriggerRising: {
+			if ((int) x + trig->hyst < trig->level) {
+				trig->edgeReady = 1;
+			} else if (trig->edgeReady && (x >= trig->level)) {
+				trig->edgeReady = 0;
+				return(1);
+			}
+			return(0);
+		}
+		case vtTriggerFalling: {
+			if ((int) x > (int) trig->level + trig->hyst) {
+				trig->edgeReady = 1;
+			} else if (trig->edgeReady && (x <= trig->level)) {
+				trig->edgeReady = 0;
+				return(1);
+			}
+			return(0);
+		}
+		case vtTriggerLevel: {
+			return(x >= trig->level);
+		}
+		default: {
+			return((x < trig->level) || (x > trig->hi));
+		}
+	}
+}
+
+/*-----------------------------------------------------------*/
+// Public API
+portBASE_TYPE vtTriggerInit(vtTrigger *trig,uint8_t kind,uint8_t level,uint8_t hiOrHyst,uint8_t pre,uint8_t post)
+{
+	if ((kind > vtTriggerWindow) || (post < 1) || (pre + post > vtTriggerMaxCapture)) return(pdFALSE);
+	if ((kind == vtTriggerWindow) && (hiOrHyst < level)) return(pdFALSE);
+	memset(trig,0,sizeof(vtTrigger));
+	trig->kind = kind;
+	trig->level = level;
+	if (kind == vtTriggerWindow) {
+		trig->hi = hiOrHyst;
+	} else {
+		trig->hyst = hiOrHyst;
+	}
+	trig->pre = pre;
+	trig->post = post;
+	return(pdTRUE);
+}
+
+void vtTriggerBlock(vtTrigger *trig,const uint8_t *data,uint8_t len,uint32_t stamp)
+{
+	uint8_t i, k;
+	uint8_t x;
+
+	for (i=0;i<len;i++) {
+		x = data[i];
+		trig->hist[trig->count & vtTriggerHistMask] = x;
+		trig->count++;
+		if (!trig->collecting) {
+			// Keep the edge detection going while frozen, but do not start another capture
+			if (!vtTriggerCheck(trig,x) || trig->frozen || (trig->count <= trig->pre)) continue;
+			// the value that met the condition is the first of the post values (and may be the only one)
+			trig->trigAt = trig->count - 1;
+			trig->trigStamp = stamp;
+			trig->collecting = 1;
+		}
+		if (trig->count - trig->trigAt < trig->post) continue;
+		// all of the post values are in: copy the capture out of the history and freeze until it is taken
+		for (k=0;k<trig->pre+trig->post;k++) {
+			trig->capture[k] = trig->hist[(trig->trigAt - trig->pre + k) & vtTriggerHistMask];
+		}
+		trig->captureStamp = trig->trigStamp;
+		trig->captures++;
+		trig->collecting = 0;
+		__DMB();
+		trig->frozen = 1;
+	}
+}
+
+uint8_t vtTriggerTake(vtTrigger *trig,uint8_t *out,uint32_t *stamp)
+{
+	uint8_t len;
+
+	if (!trig->frozen) return(0);
+	__DMB();
+	len = trig->pre + trig->post;
+	memcpy(out,trig->capture,len);
+	if (stamp != NULL) *stamp = trig->captureStamp;
+	__DMB();
+	trig->frozen = 0;
+	return(len);
+}
+// End of Public API
+/*-----------------------------------------------------------*/
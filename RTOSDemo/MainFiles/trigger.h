@@ -0,0 +1,71 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+#include "FreeRTOS.h"
+#include "lpc_types.h"
+// Oscilloscope-style trigger on the sensor values
+//   The sensor task hands every reading to vtTriggerBlock() as it comes in, so no value goes by unchecked no matter how
+//   seldom the LCD is redrawn.  The latest vtTriggerHistLen values are always kept, so when the trigger condition is
+//   met the pre values before it are already there; once post more have come in (counting the one that met the
+//   condition), the pre+post values are copied out into the capture and the trigger freezes.  Nothing more is captured
+//   until someone takes the capture with vtTriggerTake(), which arms the trigger again.
+//
+// Number of values kept (a power of 2, at least vtTriggerMaxCapture)
+#define vtTriggerHistLen 256
+// Most values in one capture (pre+post) -- as many as fit across the LCD graph
+#define vtTriggerMaxCapture 152
+
+// Kinds of trigger
+#define vtTriggerRising 0		// Goes from below level-hyst up to level or above
+#define vtTriggerFalling 1		// Goes from above level+hyst down to level or below
+#define vtTriggerLevel 2		// At level or above
+#define vtTriggerWindow 3		// Below level or above hi
+
+typedef struct __vtTrigger {
+	uint8_t kind;
+	uint8_t level;
+	uint8_t hi;					// Window only: top of the window
+	uint8_t hyst;				// Rising/falling only: how far the value must go back past level to arm the next edge
+	uint8_t pre;				// Values kept from before the one that met the condition
+	uint8_t post;				// Values kept from the one that met the condition on (at least 1)
+	// Used by vtTriggerBlock() -- do not touch
+	uint8_t hist[vtTriggerHistLen];
+	uint32_t count;				// Number of values seen so far
+	uint32_t trigAt;			// Number of the value that met the condition (while the post values come in)
+	uint32_t trigStamp;
+	uint8_t collecting;
+	uint8_t edgeReady;			// The value has been far enough past level for the next edge to count
+	// The capture (only valid while frozen)
+	uint8_t capture[vtTriggerMaxCapture];
+	uint32_t captureStamp;		// Run time counter value of the reading that met the condition
+	uint32_t captures;			// Number of captures made so far
+	volatile uint8_t frozen;
+} vtTrigger;
+
+// Set up the trigger (it starts out armed)
+// Args:
+//   trig: the trigger
+//   kind: one of the kinds above
+//   level: level to trigger at (bottom of the window for vtTriggerWindow)
+//   hiOrHyst: top of the window for vtTriggerWindow, the hysteresis for vtTriggerRising/vtTriggerFalling (otherwise ignored)
+//   pre, post: number of values kept before/from the trigger (post at least 1, pre+post up to vtTriggerMaxCapture)
+// Return:
+//   pdTRUE if the arguments are fine, pdFALSE if not
+portBASE_TYPE vtTriggerInit(vtTrigger *trig,uint8_t kind,uint8_t level,uint8_t hiOrHyst,uint8_t pre,uint8_t post);
+
+// Run values through the trigger (there must only be one task that calls this)
+// Args:
+//   trig: the trigger
+//   data: the values, oldest first
+//   len: number of values
+//   stamp: run time counter value at which they were taken
+void vtTriggerBlock(vtTrigger *trig,const uint8_t *data,uint8_t len,uint32_t stamp);
+
+// Take the capture, if there is one, and arm the trigger again (there must only be one task that calls this)
+// Args:
+//   trig: the trigger
+//   out: room for vtTriggerMaxCapture values
+//   stamp: if not NULL, gets the run time counter value of the reading that met the condition
+// Return:
+//   number of values copied out (pre+post), or 0 if nothing has been captured
+uint8_t vtTriggerTake(vtTrigger *trig,uint8_t *out,uint32_t *stamp);
+#endif
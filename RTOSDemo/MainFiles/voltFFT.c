@@ -0,0 +1,172 @@
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "voltFFT.h"
+
+/* *********************************************** */
+// definitions that are private to this file
+#if (vtFFTMaxLen != 512)
+The twiddle table below is for 512 points
+#endif
+// sin(2*pi*m/512) in Q15 (32767 for 1), m = 0..383 -- cos(2*pi*m/512) is the entry 128 further on
+//   Made with: [round(32767*sin(2*pi*m/512)) for m in range(384)]
+static const int16_t vtFFTSin[384] = {
+	0,402,804,1206,1608,2009,2410,2811,3212,3612,4011,4410,
+	4808,5205,5602,5998,6393,6786,7179,7571,7962,8351,8739,9126,
+	9512,9896,10278,10659,11039,11417,11793,12167,12539,12910,13279,13645,
+	14010,14372,14732,15090,15446,15800,16151,16499,16846,17189,17530,17869,
+	18204,18537,18868,19195,19519,19841,20159,20475,20787,21096,21403,21705,
+	22005,22301,22594,22884,23170,23452,23731,24007,24279,24547,24811,25072,
+	25329,25582,25832,26077,26319,26556,26790,27019,27245,27466,27683,27896,
+	28105,28310,28510,28706,28898,29085,29268,29447,29621,29791,29956,30117,
+	30273,30424,30571,30714,30852,30985,31113,31237,31356,31470,31580,31685,
+	31785,31880,31971,32057,32137,32213,32285,32351,32412,32469,32521,32567,
+	32609,32646,32678,32705,32728,32745,32757,32765,32767,32765,32757,32745,
+	32728,32705,32678,32646,32609,32567,32521,32469,32412,32351,32285,32213,
+	32137,32057,31971,31880,31785,31685,31580,31470,31356,31237,31113,30985,
+	30852,30714,30571,30424,30273,30117,29956,29791,29621,29447,29268,29085,
+	28898,28706,28510,28310,28105,27896,27683,27466,27245,27019,26790,26556,
+	26319,26077,25832,25582,25329,25072,24811,24547,24279,24007,23731,23452,
+	23170,22884,22594,22301,22005,21705,21403,21096,20787,20475,20159,19841,
+	19519,19195,18868,18537,18204,17869,17530,17189,16846,16499,16151,15800,
+	15446,15090,14732,14372,14010,13645,13279,12910,12539,12167,11793,11417,
+	11039,10659,10278,9896,9512,9126,8739,8351,7962,7571,7179,6786,
+	6393,5998,5602,5205,4808,4410,4011,3612,3212,2811,2410,2009,
+	1608,1206,804,402,0,-402,-804,-1206,-1608,-2009,-2410,-2811,
+	-3212,-3612,-4011,-4410,-4808,-5205,-5602,-5998,-6393,-6786,-7179,-7571,
+	-7962,-8351,-8739,-9126,-9512,-9896,-10278,-10659,-11039,-11417,-11793,-12167,
+	-12539,-12910,-13279,-13645,-14010,-14372,-14732,-15090,-15446,-15800,-16151,-16499,
+	-16846,-17189,-17530,-17869,-18204,-18537,-18868,-19195,-19519,-19841,-20159,-20475,
+	-20787,-21096,-21403,-21705,-22005,-22301,-22594,-22884,-23170,-23452,-23731,-24007,
+	-24279,-24547,-24811,-25072,-25329,-25582,-25832,-26077,-26319,-26556,-26790,-27019,
+	-27245,-27466,-27683,-27896,-28105,-28310,-28510,-28706,-28898,-29085,-29268,-29447,
+	-29621,-29791,-29956,-30117,-30273,-30424,-30571,-30714,-30852,-30985,-31113,-31237,
+	-31356,-31470,-31580,-31685,-31785,-31880,-31971,-32057,-32137,-32213,-32285,-32351,
+	-32412,-32469,-32521,-32567,-32609,-32646,-32678,-32705,-32728,-32745,-32757,-32765
+};
+#define vtFFTCos(m) (vtFFTSin[(m)+128])
+// end of defs
+/* *********************************************** */
+
+// The transform itself, in place on fft->re/fft->im (decimation in time)
+static void vtFFTTransform(vtFFT *fft)
+{
+	int16_t *re = fft->re;
+	int16_t *im = fft->im;
+	uint16_t n = fft->len;
+	uint16_t i, j, k, half, step;
+	int32_t c, s, tr, ti, ar, ai;
+	int16_t t;
+
+	// Bit reversed order (the index is reversed in one instruction and shifted down to the number of bits)
+	for (i=0;i<n;i++) {
+		j = __RBIT(i) >> (32 - fft->bits);
+		if (j > i) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+	// The first stage only adds and subtracts (the twiddle is 1)
+	for (i=0;i<n;i+=2) {
+		ar = re[i]; ai = im[i];
+		re[i] = (ar + re[i+1]) >> 1; im[i] = (ai + im[i+1]) >> 1;
+		re[i+1] = (ar - re[i+1]) >> 1; im[i+1] = (ai - im[i+1]) >> 1;
+	}
+	// The rest: butterflies half apart, with twiddles exp(-2*pi*i*k/(2*half)), which is every step'th entry of the table
+	for (half=2;half<n;half<<=1) {
+		step = (vtFFTMaxLen/2) / half;
+		for (k=0;k<half;k++) {
+			c = vtFFTCos(k*step);
+			s = vtFFTSin[k*step];
+			for (i=k;i<n;i+=2*half) {
+				j = i + half;
+				// (re + i*im) * (c - i*s)
+				tr = (c * re[j] + s * im[j]) >> 15;
+				ti = (c * im[j] - s * re[j]) >> 15;
+				ar = re[i]; ai = im[i];
+				// halving keeps every value within the magnitude of the input, but rounding can still go 1 over
+				re[j] = __SSAT((ar - tr) >> 1,16); im[j] = __SSAT((ai - ti) >> 1,16);
+				re[i] = __SSAT((ar + tr) >> 1,16); im[i] = __SSAT((ai + ti) >> 1,16);
+			}
+		}
+	}
+}
+
+/*-----------------------------------------------------------*/
+// Public API
+portBASE_TYPE vtFFTInit(vtFFT *fft,uint16_t len)
+{
+	if ((len < vtFFTMinLen) || (len > vtFFTMaxLen) || (len & (len-1))) return(pdFALSE);
+	memset(fft,0,sizeof(vtFFT));
+	fft->len = len;
+	fft->bits = 31 - __CLZ(len);
+	vtCycleCountInit();
+	return(pdTRUE);
+}
+
+void vtFFTAdd(vtFFT *fft,const uint8_t *data,uint16_t count)
+{
+	uint16_t i;
+
+	for (i=0;i<count;i++) {
+		fft->in[fft->inPos] = data[i];
+		if (++fft->inPos == fft->len) fft->inPos = 0;
+	}
+	fft->inCount = (fft->inCount + count > fft->len) ? fft->len : fft->inCount + count;
+}
+
+portBASE_TYPE vtFFTRun(vtFFT *fft)
+{
+	uint32_t start = vtCycleCount();
+	uint16_t n = fft->len;
+	uint16_t i, k, a, b;
+	uint32_t sum = 0;
+	int32_t mean, x, w;
+
+	if (fft->inCount < n) return(pdFALSE);
+	// Oldest value first; the mean (which would only swamp bin 0) is taken out
+	for (i=0;i<n;i++) {
+		sum += fft->in[i];
+	}
+	mean = sum >> fft->bits;
+	k = fft->inPos;
+	for (i=0;i<n;i++) {
+		// 8 bits (less the mean, so 9 with the sign) up to Q15, then the Hann window: sin(pi*i/n) squared (at 512 points,
+		//   two values in a row share a window value, which is close enough)
+		x = ((int32_t) fft->in[k] - mean) << 7;
+		w = vtFFTSin[((uint32_t) i * (vtFFTMaxLen/2)) >> fft->bits];
+		x = (x * ((w * w) >> 15)) >> 15;
+		fft->re[i] = x;
+		fft->im[i] = 0;
+		if (++k == n) k = 0;
+	}
+	vtFFTTransform(fft);
+	// The input is real, so the top half of the bins mirrors the bottom half
+	fft->peak = 1;
+	for (k=0;k<n/2;k++) {
+		a = (fft->re[k] < 0) ? -fft->re[k] : fft->re[k];
+		b = (fft->im[k] < 0) ? -fft->im[k] : fft->im[k];
+		fft->mag[k] = (a > b) ? a + ((3 * b) >> 3) : b + ((3 * a) >> 3);
+		if ((k != 0) && (fft->mag[k] > fft->mag[fft->peak])) fft->peak = k;
+	}
+	fft->runs++;
+	fft->lastCycles = vtCycleCount() - start;
+	if (fft->lastCycles > fft->maxCycles) fft->maxCycles = fft->lastCycles;
+	return(pdTRUE);
+}
+
+uint8_t vtFFTLevel(uint16_t mag)
+{
+	uint8_t lead;
+
+	if (mag == 0) return(0);
+	// the position of the top bit, and the 3 bits after it as the fraction
+	lead = __CLZ(mag);
+	return(((31 - lead) << 3) + ((((uint32_t) mag << lead) >> 28) & 7) + 1);
+}
+// End of Public API
+/*-----------------------------------------------------------*/
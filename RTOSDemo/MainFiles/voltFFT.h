@@ -0,0 +1,54 @@
+#ifndef VOLT_FFT_H
+#define VOLT_FFT_H
+#include "FreeRTOS.h"
+#include "lpc_types.h"
+// Spectrum of the sensor values
+//   The latest len values are kept as they come in (vtFFTAdd()), and vtFFTRun() turns them into a magnitude spectrum:
+//   the mean is taken out, a Hann window is put on, and a radix-2 FFT is done in Q15 fixed point (in place, scaled by
+//   1/2 at every stage so that nothing can overflow -- the result is the transform divided by len).  The sines and
+//   cosines come from a table in flash, and the magnitudes are worked out without a square root (the larger part plus
+//   3/8 of the smaller one, within about 7%), which is plenty for a display.
+//
+// Most points (a power of 2 -- the twiddle table in voltFFT.c is for this length)
+#define vtFFTMaxLen 512
+// Fewest points
+#define vtFFTMinLen 64
+
+typedef struct __vtFFT {
+	uint16_t len;					// Number of points
+	uint8_t bits;					// log2(len)
+	// The latest values (written over in a circle)
+	uint8_t in[vtFFTMaxLen];
+	uint16_t inPos;					// Where the next one goes
+	uint16_t inCount;				// Number in there (up to len)
+	// The transform is done in here
+	int16_t re[vtFFTMaxLen];
+	int16_t im[vtFFTMaxLen];
+	// The result of the latest vtFFTRun() -- bin k is k/len of the sample rate (up to half of it)
+	uint16_t mag[vtFFTMaxLen/2];
+	uint16_t peak;					// The bin with the largest magnitude (leaving out bin 0)
+	uint32_t runs;					// Number of spectra worked out
+	// CPU cycles taken by the latest vtFFTRun() and the most that one has taken
+	uint32_t lastCycles;
+	uint32_t maxCycles;
+} vtFFT;
+
+// Set up the spectrum
+// Args:
+//   fft: the spectrum
+//   len: number of points (a power of 2, vtFFTMinLen to vtFFTMaxLen)
+// Return:
+//   pdTRUE if len is fine, pdFALSE if not
+portBASE_TYPE vtFFTInit(vtFFT *fft,uint16_t len);
+
+// Add values, oldest first
+void vtFFTAdd(vtFFT *fft,const uint8_t *data,uint16_t count);
+
+// Work out the spectrum of the latest len values (into mag and peak)
+// Return:
+//   pdTRUE, or pdFALSE if len values have not come in yet
+portBASE_TYPE vtFFTRun(vtFFT *fft);
+
+// log2 of a magnitude, in 1/8ths (6dB is 8) -- 0 for 0, and 128 for the largest magnitude there can be
+uint8_t vtFFTLevel(uint16_t mag);
+#endif
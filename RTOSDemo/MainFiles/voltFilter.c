@@ -0,0 +1,148 @@
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "voltFilter.h"
+
+/* *********************************************** */
+// definitions that are private to this file
+// Samples are centered on this before going through the FIR, so that taps that do not add up to exactly 32768 scale
+//   around the middle of the range instead of around 0
+#define vtVoltFilterMid 128
+// end of defs
+/* *********************************************** */
+
+const int16_t vtVoltFilterLowPass[8] = {116,1248,5277,9743,9743,5277,1248,116};
+
+// log 2 of x if x is a power of 2 from 1 to max, otherwise -1
+static int vtVoltFilterLog2(uint8_t x,uint8_t max)
+{
+	int n;
+
+	for (n=0;(1 << n) <= max;n++) {
+		if ((1 << n) == x) return(n);
+	}
+	return(-1);
+}
+
+/*-----------------------------------------------------------*/
+// Public API
+portBASE_TYPE vtVoltFilterInit(vtVoltFilter *f,uint8_t kind,uint8_t decim,uint8_t len,const int16_t *taps)
+{
+	int decimShift = vtVoltFilterLog2(decim,vtVoltFilterBlockLen);
+	int lenShift;
+
+	if (decimShift < 0) return(pdFALSE);
+	memset(f,0,sizeof(vtVoltFilter));
+	f->kind = kind;
+	f->decim = decim;
+	f->len = len;
+	f->taps = taps;
+	switch (kind) {
+		case vtVoltFilterNone: {
+			break;
+		}
+		case vtVoltFilterAvg: {
+			if ((lenShift = vtVoltFilterLog2(len,vtVoltFilterMaxLen)) < 0) return(pdFALSE);
+			f->shift = lenShift;
+			break;
+		}
+		case vtVoltFilterCic: {
+			if ((len < 1) || (len > vtVoltFilterMaxOrder)) return(pdFALSE);
+			f->shift = decimShift * len;
+			break;
+		}
+		case vtVoltFilterFir: {
+			if ((len < 1) || (len > vtVoltFilterMaxLen) || (taps == NULL)) return(pdFALSE);
+			// start out as if the input had been in the middle of the range all along
+			memset(f->hist,vtVoltFilterMid,sizeof(f->hist));
+			break;
+		}
+		default: {
+			return(pdFALSE);
+		}
+	}
+	vtCycleCountInit();
+	return(pdTRUE);
+}
+
+uint8_t vtVoltFilterBlock(vtVoltFilter *f,const uint8_t *in,uint8_t *out)
+{
+	uint32_t start = vtCycleCount();
+	uint8_t count = 0;
+	uint8_t i, k, x;
+	uint32_t y, prev;
+	int32_t acc;
+	const uint8_t *w;
+
+	for (i=0;i<vtVoltFilterBlockLen;i++) {
+		x = in[i];
+		// Work that has to be done for every sample
+		switch (f->kind) {
+			case vtVoltFilterAvg:
+			case vtVoltFilterFir: {
+				// hist[pos] is now the newest sample and hist[pos+k] the one k samples before it
+				f->pos = ((f->pos == 0) ? f->len : f->pos) - 1;
+				// the sample that drops out of the average is the one being overwritten
+				f->sum += x - f->hist[f->pos];
+				f->hist[f->pos] = x;
+				f->hist[f->pos+f->len] = x;
+				break;
+			}
+			case vtVoltFilterCic: {
+				// the integrators wrap around, which the combs undo (so they are unsigned)
+				y = x;
+				for (k=0;k<f->len;k++) {
+					f->integ[k] += y;
+					y = f->integ[k];
+				}
+				break;
+			}
+			default: {
+				break;
+			}
+		}
+		if (++f->phase < f->decim) continue;
+		f->phase = 0;
+		// ...and for every output that is kept (the FIR is only worked out for these)
+		switch (f->kind) {
+			case vtVoltFilterAvg: {
+				out[count++] = f->sum >> f->shift;
+				break;
+			}
+			case vtVoltFilterCic: {
+				y = f->integ[f->len-1];
+				for (k=0;k<f->len;k++) {
+					prev = f->comb[k];
+					f->comb[k] = y;
+					y -= prev;
+				}
+				out[count++] = y >> f->shift;
+				break;
+			}
+			case vtVoltFilterFir: {
+				w = &(f->hist[f->pos]);
+				acc = 0;
+				for (k=0;k<f->len;k++) {
+					acc += f->taps[k] * (w[k] - vtVoltFilterMid);
+				}
+				// round, put back in the middle of the range, and clamp to 0..255 (taps with negative values can overshoot)
+				out[count++] = __USAT(((acc + (1 << 14)) >> 15) + vtVoltFilterMid,8);
+				break;
+			}
+			default: {
+				out[count++] = x;
+				break;
+			}
+		}
+	}
+	f->lastCycles = vtCycleCount() - start;
+	if (f->lastCycles > f->maxCycles) f->maxCycles = f->lastCycles;
+	f->blocks++;
+	return(count);
+}
+// End of Public API
+/*-----------------------------------------------------------*/
@@ -0,0 +1,63 @@
+#ifndef VOLT_FILTER_H
+#define VOLT_FILTER_H
+#include "FreeRTOS.h"
+#include "lpc_types.h"
+// Integer-only filter for the sensor readings
+//   Works on whole readings (vtVoltFilterBlockLen 8 bit samples at a time) and keeps only every decim'th output, so the
+//   sensor can be read fast while the LCD gets a cleaner stream at a lower rate.  Everything is done with integers;
+//   FIR results are saturated (with the USAT instruction) instead of being allowed to wrap.
+//
+// Number of samples handed in at a time (one reading of the sensor)
+#define vtVoltFilterBlockLen 8
+// Longest moving average / FIR, and highest CIC order
+#define vtVoltFilterMaxLen 16
+#define vtVoltFilterMaxOrder 4
+
+// Kinds of filter
+#define vtVoltFilterNone 0		// Samples are passed on as is (but still decimated)
+#define vtVoltFilterAvg 1		// Moving average of the latest len samples (len a power of 2)
+#define vtVoltFilterCic 2		// CIC decimator of order len (gain decim^len, which is divided out)
+#define vtVoltFilterFir 3		// FIR with len taps (Q15, should add up to 32768 for a gain of 1)
+
+typedef struct __vtVoltFilter {
+	uint8_t kind;
+	uint8_t decim;			// 1, 2, 4 or 8 -- each block gives vtVoltFilterBlockLen/decim outputs
+	uint8_t len;
+	uint8_t shift;			// Gain that is divided out (log 2)
+	const int16_t *taps;	// FIR only: taps[0] goes with the newest sample
+	// Used by the filter -- do not touch
+	uint8_t hist[2*vtVoltFilterMaxLen];	// Latest len samples, kept twice so that they can always be read in one piece
+	uint8_t pos;
+	uint8_t phase;							// Samples since the latest output
+	int32_t sum;							// Moving average: sum of the samples in hist
+	uint32_t integ[vtVoltFilterMaxOrder];	// CIC: integrator outputs
+	uint32_t comb[vtVoltFilterMaxOrder];	// CIC: comb inputs at the previous output
+	// Cost of vtVoltFilterBlock() in CPU cycles
+	uint32_t blocks;
+	uint32_t lastCycles;
+	uint32_t maxCycles;
+} vtVoltFilter;
+
+// 8 tap low pass (cut off at 1/8 of the sample rate), for use with decim 4
+extern const int16_t vtVoltFilterLowPass[8];
+
+// Set up a filter (also starts the cycle counter, see vtCycleCountInit())
+// Args:
+//   f: the filter
+//   kind: one of the kinds above
+//   decim: keep every decim'th output (1, 2, 4 or 8)
+//   len: number of samples averaged, CIC order, or number of FIR taps (ignored for vtVoltFilterNone)
+//   taps: the FIR taps (must stay around; ignored for the other kinds)
+// Return:
+//   pdTRUE if the arguments are fine, pdFALSE if not
+portBASE_TYPE vtVoltFilterInit(vtVoltFilter *f,uint8_t kind,uint8_t decim,uint8_t len,const int16_t *taps);
+
+// Run one reading through the filter
+// Args:
+//   f: the filter
+//   in: vtVoltFilterBlockLen samples, oldest first
+//   out: where the outputs go (vtVoltFilterBlockLen/decim of them)
+// Return:
+//   number of outputs
+uint8_t vtVoltFilterBlock(vtVoltFilter *f,const uint8_t *in,uint8_t *out);
+#endif
@@ -0,0 +1,178 @@
+#include <string.h>
+
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+
+/* include files. */
+#include "vtUtilities.h"
+#include "voltStats.h"
+
+/* *********************************************** */
+// definitions that are private to this file
+#if (vtStatsMaxSlide & (vtStatsMaxSlide-1)) || (vtStatsMaxSlide > 128)
+vtStatsMaxSlide must be a power of 2, and no more than 128 (the queue positions are 8 bits)
+#endif
+#define vtStatsMask (vtStatsMaxSlide-1)
+// Bits after the point in the tumbling mean
+#define vtStatsMeanBits 16
+// end of defs
+/* *********************************************** */
+
+// Integer square root (rounded down)
+static uint32_t vtStatsSqrt(uint32_t x)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > x) bit >>= 2;
+	while (bit != 0) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return(root);
+}
+
+// Put out a new snapshot: fill in the copy that readers are not looking at, then switch to it
+static void vtStatsPublish(vtStatsPub *pub,const vtStatsSnap *snap)
+{
+	pub->copy[(pub->seq + 1) & 1] = *snap;
+	__DMB();
+	pub->seq++;
+}
+
+static void vtStatsRead(vtStatsPub *pub,vtStatsSnap *snap)
+{
+	uint32_t seq;
+
+	do {
+		seq = pub->seq;
+		__DMB();
+		*snap = pub->copy[seq & 1];
+		__DMB();
+	} while (pub->seq != seq);
+}
+
+// The sliding snapshot, worked out from the sums
+static void vtStatsSlideSnap(vtStats *stats,uint32_t stamp)
+{
+	vtStatsSnap snap;
+	uint32_t n = stats->filled;
+
+	snap.count = n;
+	snap.windows = 0;
+	snap.stamp = stamp;
+	snap.max = stats->hist[stats->maxQ[stats->maxHead & vtStatsMask] & vtStatsMask];
+	snap.min = stats->hist[stats->minQ[stats->minHead & vtStatsMask] & vtStatsMask];
+	snap.p2p = snap.max - snap.min;
+	snap.mean = (stats->sum << 8) / n;
+	// n*sumSq - sum*sum is n*n times the variance (and both terms fit in 32 bits)
+	snap.var = (((uint64_t) (n * stats->sumSq - stats->sum * stats->sum)) << 8) / (n * n);
+	snap.rms = vtStatsSqrt((((uint64_t) stats->sumSq) << 16) / n);
+	vtStatsPublish(&(stats->slide),&snap);
+}
+
+// The tumbling snapshot, worked out at the end of each window
+static void vtStatsTumbleSnap(vtStats *stats,uint32_t stamp)
+{
+	vtStatsSnap snap;
+	uint32_t varQ16;
+
+	snap.count = stats->n;
+	snap.windows = stats->windows;
+	snap.stamp = stamp;
+	snap.min = stats->tMin;
+	snap.max = stats->tMax;
+	snap.p2p = snap.max - snap.min;
+	snap.mean = (stats->mean + (1 << (vtStatsMeanBits - 9))) >> (vtStatsMeanBits - 8);
+	varQ16 = (stats->m2 / stats->n) >> (2*vtStatsMeanBits - 16);
+	snap.var = varQ16 >> 8;
+	// mean square = variance + mean squared (the mean at full precision, as the one in the snapshot is rounded)
+	snap.rms = vtStatsSqrt(varQ16 + (uint32_t) (((uint64_t) stats->mean * stats->mean) >> (2*vtStatsMeanBits - 16)));
+	vtStatsPublish(&(stats->tumble),&snap);
+}
+
+/*-----------------------------------------------------------*/
+// Public API
+portBASE_TYPE vtStatsInit(vtStats *stats,uint16_t slideLen,uint16_t tumbleLen)
+{
+	if ((slideLen < 1) || (slideLen > vtStatsMaxSlide) || (tumbleLen < 1)) return(pdFALSE);
+	memset(stats,0,sizeof(vtStats));
+	stats->slideLen = slideLen;
+	stats->tumbleLen = tumbleLen;
+	return(pdTRUE);
+}
+
+void vtStatsBlock(vtStats *stats,const uint8_t *data,uint8_t len,uint32_t stamp)
+{
+	uint8_t i, x, old;
+	int32_t delta;
+
+	if (len == 0) return;
+	for (i=0;i<len;i++) {
+		x = data[i];
+		// Sliding window: whatever is about to leave it goes from the front of the queues first, so that they never
+		//   hold more than slideLen values and nothing in them refers to the slot that x is about to take over
+		if ((stats->maxTail != stats->maxHead) && ((uint16_t) (stats->count - stats->maxQ[stats->maxHead & vtStatsMask]) >= stats->slideLen)) stats->maxHead++;
+		if ((stats->minTail != stats->minHead) && ((uint16_t) (stats->count - stats->minQ[stats->minHead & vtStatsMask]) >= stats->slideLen)) stats->minHead++;
+		// the oldest value drops out of the sums once the window is full
+		if (stats->filled == stats->slideLen) {
+			old = stats->hist[(uint16_t) (stats->count - stats->slideLen) & vtStatsMask];
+			stats->sum -= old;
+			stats->sumSq -= (uint32_t) old * old;
+		} else {
+			stats->filled++;
+		}
+		stats->hist[stats->count & vtStatsMask] = x;
+		stats->sum += x;
+		stats->sumSq += (uint32_t) x * x;
+		// values that can never be the max (or min) again, because x came after them, are dropped from the back
+		while ((stats->maxTail != stats->maxHead) && (stats->hist[stats->maxQ[(stats->maxTail-1) & vtStatsMask] & vtStatsMask] <= x)) stats->maxTail--;
+		stats->maxQ[stats->maxTail++ & vtStatsMask] = stats->count;
+		while ((stats->minTail != stats->minHead) && (stats->hist[stats->minQ[(stats->minTail-1) & vtStatsMask] & vtStatsMask] >= x)) stats->minTail--;
+		stats->minQ[stats->minTail++ & vtStatsMask] = stats->count;
+		stats->count++;
+
+		// Tumbling window (Welford)
+		if (stats->n == 0) {
+			stats->mean = 0;
+			stats->m2 = 0;
+			stats->tMin = x;
+			stats->tMax = x;
+		}
+		stats->n++;
+		delta = ((int32_t) x << vtStatsMeanBits) - stats->mean;
+		// rounded to the nearest step rather than toward 0, which would pull the mean (and the variance) down a little
+		//   on every value
+		if (delta >= 0) {
+			stats->mean += (delta + (int32_t) (stats->n / 2)) / (int32_t) stats->n;
+		} else {
+			stats->mean += (delta - (int32_t) (stats->n / 2)) / (int32_t) stats->n;
+		}
+		stats->m2 += (int64_t) delta * (((int32_t) x << vtStatsMeanBits) - stats->mean);
+		if (x < stats->tMin) stats->tMin = x;
+		if (x > stats->tMax) stats->tMax = x;
+		if (stats->n == stats->tumbleLen) {
+			stats->windows++;
+			vtStatsTumbleSnap(stats,stamp);
+			stats->n = 0;
+		}
+	}
+	vtStatsSlideSnap(stats,stamp);
+}
+
+void vtStatsGetSliding(vtStats *stats,vtStatsSnap *snap)
+{
+	vtStatsRead(&(stats->slide),snap);
+}
+
+void vtStatsGetTumbling(vtStats *stats,vtStatsSnap *snap)
+{
+	vtStatsRead(&(stats->tumble),snap);
+}
+// End of Public API
+/*-----------------------------------------------------------*/
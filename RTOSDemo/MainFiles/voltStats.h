@@ -0,0 +1,79 @@
+#ifndef VOLT_STATS_H
+#define VOLT_STATS_H
+#include "FreeRTOS.h"
+#include "lpc_types.h"
+// Running statistics of the sensor values
+//   The sensor task hands every reading to vtStatsBlock(), which updates the statistics in a fixed amount of work per
+//   value (nothing is ever rescanned), over two kinds of window:
+//     sliding: the latest slideLen values (exact integer sums; min/max with monotonic queues)
+//     tumbling: one after the other, tumbleLen values each (Welford's method in fixed point, so any length works)
+//   Any task can read the latest snapshot of either one without locking: each is kept twice, the writer fills in the
+//   copy that is not being read and then switches, and a reader that sees a switch while it is copying tries again.
+//   A reader never holds up the writer, and a higher priority reader never waits for a writer it has preempted.
+//
+// Longest sliding window (a power of 2)
+#define vtStatsMaxSlide 128
+
+// Statistics over one window -- mean, var and rms are in 1/256ths of the value
+typedef struct __vtStatsSnap {
+	uint32_t count;			// Values in the window (less than its length until enough have come in)
+	uint32_t windows;		// Tumbling only: number of windows finished so far
+	uint32_t stamp;			// Run time counter value of the latest value in the window
+	uint8_t min;
+	uint8_t max;
+	uint8_t p2p;			// max - min
+	uint16_t mean;
+	uint32_t var;
+	uint16_t rms;
+} vtStatsSnap;
+
+// Used by the statistics -- do not touch
+typedef struct __vtStatsPub {
+	vtStatsSnap copy[2];
+	volatile uint32_t seq;	// Incremented after each new snapshot; copy[seq & 1] is the latest one
+} vtStatsPub;
+
+typedef struct __vtStats {
+	uint16_t slideLen;
+	uint16_t tumbleLen;
+	// Sliding window (writer only)
+	uint8_t hist[vtStatsMaxSlide];
+	uint16_t count;							// Number of the next value (wraps around)
+	uint16_t filled;						// Values in the window
+	uint32_t sum, sumSq;
+	uint16_t maxQ[vtStatsMaxSlide];			// Numbers of the values that may still become the max (values decreasing)
+	uint16_t minQ[vtStatsMaxSlide];			// ... and the min (values increasing)
+	uint8_t maxHead, maxTail, minHead, minTail;
+	// Tumbling window (writer only)
+	uint16_t n;
+	int32_t mean;							// in 1/65536ths
+	int64_t m2;								// sum of squared differences from the mean, in 1/65536ths squared
+	uint8_t tMin, tMax;
+	uint32_t windows;
+	// What the readers see
+	vtStatsPub slide;
+	vtStatsPub tumble;
+} vtStats;
+
+// Set up the statistics
+// Args:
+//   stats: the statistics
+//   slideLen: length of the sliding window (1 to vtStatsMaxSlide)
+//   tumbleLen: length of the tumbling window (at least 1)
+// Return:
+//   pdTRUE if the arguments are fine, pdFALSE if not
+portBASE_TYPE vtStatsInit(vtStats *stats,uint16_t slideLen,uint16_t tumbleLen);
+
+// Add values (there must only be one task that calls this) -- the sliding snapshot is updated once per call
+// Args:
+//   stats: the statistics
+//   data: the values, oldest first
+//   len: number of values
+//   stamp: run time counter value at which they were taken
+void vtStatsBlock(vtStats *stats,const uint8_t *data,uint8_t len,uint32_t stamp);
+
+// Get the latest snapshot of the sliding window (any task, as often as it likes)
+void vtStatsGetSliding(vtStats *stats,vtStatsSnap *snap);
+// Get the snapshot of the latest tumbling window to finish (all 0 until the first one does)
+void vtStatsGetTumbling(vtStats *stats,vtStatsSnap *snap);
+#endif
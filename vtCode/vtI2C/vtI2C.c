@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "vtI2C.h"
 /* Scheduler include files. */
@@ -17,23 +18,40 @@
 
 /* ************************************************ */
 // Private definitions used in the Public API
-// Structure used to define the messages that are sent to/from the I2C thread 
-typedef struct __vtI2CMsg {
-	uint8_t msgType; // A field you will likely use in your communications between processors (and for debugging)
-	uint8_t slvAddr; // Address of the device to whom the message is being sent (or was sent)
-	uint8_t	rxLen;	 // Length of the message you *expect* to receive (or, on the way back, the length that *was* received)
-	uint8_t txLen;   // Length of the message you want to sent (or, on the way back, the length that *was* sent)
-	uint8_t status;  // status of the completed operation -- I've not done anything much here, you probably should...
-	uint8_t buf[vtI2CMLen]; // On the way in, message to be sent, on the way out, message received (if any)
-} vtI2CMsg;
-// Length of the message queues to/from this task
-#define vtI2CQLen 10
+// Length of the message queues to/from this task -- only pointers go through them and there are never more
+//   than vtI2CPoolLen descriptors around, so the queues can never overflow
+#define vtI2CQLen vtI2CPoolLen
 
 #define vtI2CTransferFailed -2
+#if (vtI2CChainLen & (vtI2CChainLen-1)) || (vtI2CChainLen > vtI2CPoolLen)
+vtI2CChainLen must be a power of 2 that is no larger than vtI2CPoolLen
+#endif
+#define vtI2CRingMask (vtI2CChainLen-1)
 #define vtI2CIntPriority 7
+// Cycle counter readings to microseconds (for the latency counts and histograms)
+#define vtI2CCyclesToUs(c) ((c) / (SystemCoreClock / 1000000UL))
 
 // Here is where we define an array of pointers that lets communication occur between the interrupt handler and the rest of the code in this file
 static 	vtI2CStruct *devStaticPtr[3];
+// Interrupt handlers that have taken over an I2C peripheral (see vtI2CAttachIsr())
+static struct {
+	vtI2CIsrHook isr;
+	void *arg;
+} isrHook[3];
+
+// The I2C peripherals of the 1768 and the pins (on port 0) that they are wired to
+typedef struct {
+	LPC_I2C_TypeDef *devAddr;
+	IRQn_Type irq;
+	uint8_t sdaPin, sclPin;
+	uint8_t pinFunc;		// Pin function that connects the pins to the I2C peripheral
+	uint8_t pinOpenDrain;	// Regular port pins must be put in open drain mode to be used for I2C
+} vtI2CHwDesc;
+static const vtI2CHwDesc vtI2CHw[3] = {
+	{ LPC_I2C0, I2C0_IRQn, 27, 28, 1, 0 },	// SDA0 on P0.27, SCL0 on P0.28
+	{ LPC_I2C1, I2C1_IRQn, 0, 1, 3, 0 },	// SDA1 on P0.0, SCL1 on P0.1
+	{ LPC_I2C2, I2C2_IRQn, 10, 11, 2, 1 },	// SDA2 on P0.10, SCL2 on P0.11
+};
 
 // I have set this to a large stack size because of (a) using printf() and (b) the depth of function calls
 //   for some of the I2C operations -- it is possible/very likely these are much larger than needed (see LCDtask.c for how to check the stack size)
@@ -46,6 +64,15 @@ static 	vtI2CStruct *devStaticPtr[3];
 
 /* The I2C monitor tasks. */
 static portTASK_FUNCTION_PROTO( vI2CMonitorTask, pvParameters );
+static void vtI2CConfigPins(uint8_t devNum,uint8_t func);
+
+// Timeouts
+// Shortest time a transaction is given, on top of the time that its bytes take on the bus
+#define vtI2CTimeoutMinTicks ( ( portTickType ) 5 / portTICK_RATE_MS)
+// Number of times the NXP driver tries a transaction (see retransmissions_max below)
+#define vtI2CTries 4
+// Busy-wait loop count for half of an SCL period while clearing the bus (about 5us, i.e., 100KHz, at 100MHz)
+#define vtI2CBusClearDelay 100
 // End of private definitions
 /* ************************************************ */
 
@@ -55,52 +82,58 @@ static portTASK_FUNCTION_PROTO( vI2CMonitorTask, pvParameters );
 // Note: This will startup an I2C thread, once for each call to this routine
 int vtI2CInit(vtI2CStruct *devPtr,uint8_t i2cDevNum,unsigned portBASE_TYPE taskPriority,uint32_t i2cSpeed)
 {
-	PINSEL_CFG_Type PinCfg;
+	int i;
 
 	devPtr->devNum = i2cDevNum;
 	devPtr->taskPriority = taskPriority;
+	// the latency counts and histograms are timed with the cycle counter
+	vtCycleCountInit();
+	devPtr->ringHead = 0;
+	devPtr->ringTail = 0;
+	devPtr->placedLoad = 0;
+	for (i=0;i<4;i++) {
+		devPtr->placedAddr[i] = 0;
+	}
+	for (i=0;i<vtI2CMaxPollJobs;i++) {
+		devPtr->poll[i] = NULL;
+	}
+	devPtr->coalesceWindow = 0;
+	devPtr->slaveCount = 0;
+	devPtr->coalesced = 0;
+	devPtr->cacheHits = 0;
+	for (i=0;i<vtI2CCacheLen;i++) {
+		devPtr->cache[i].valid = 0;
+	}
+	for (i=0;i<vtI2CNumPrio;i++) {
+		devPtr->latency[i].count = 0;
+		devPtr->latency[i].total = 0;
+		devPtr->latency[i].max = 0;
+	}
+
+	devPtr->progDropped = 0;
+	devPtr->progStep.msgType = 0;
+	devPtr->progStep.txLen = 0;
+	devPtr->progStep.rxLen = 0;
+	devPtr->progStep.segCount = 0;
+	devPtr->progStep.timeout = 0;
+	devPtr->progStep.priority = vtI2CPrioNormal;
+	devPtr->progStep.prog = NULL;
+
+	devPtr->speed = i2cSpeed;
+	devPtr->timeouts = 0;
+	devPtr->recoveries = 0;
 
 	int retval = vtI2CInitSuccess;
-	switch (devPtr->devNum) {
-		case 0: {
-			devStaticPtr[0] = devPtr; // Setup the permanent variable for use by the interrupt handler
-			devPtr->devAddr = LPC_I2C0;
-			// Start with the interrupts disabled *and* make sure we have the priority correct
-			NVIC_SetPriority(I2C0_IRQn,vtI2CIntPriority);	
-			NVIC_DisableIRQ(I2C0_IRQn);
-			// Init I2C pin connect
-			PinCfg.OpenDrain = 0;
-			PinCfg.Pinmode = 0;
-			PinCfg.Funcnum = 1;
-			PinCfg.Pinnum = 27;
-			PinCfg.Portnum = 0;
-			PINSEL_ConfigPin(&PinCfg);
-			PinCfg.Pinnum = 28;
-			PINSEL_ConfigPin(&PinCfg);
-			break;
-		}
-		case 1: {
-			devStaticPtr[1] = devPtr; // Setup the permanent variable for use by the interrupt handler
-			devPtr->devAddr = LPC_I2C1;
-			// Start with the interrupts disabled *and* make sure we have the priority correct
-			NVIC_SetPriority(I2C1_IRQn,vtI2CIntPriority);	
-			NVIC_DisableIRQ(I2C1_IRQn);
-			// Init I2C pin connect
-			PinCfg.OpenDrain = 0;
-			PinCfg.Pinmode = 0;
-			PinCfg.Funcnum = 3;
-			PinCfg.Pinnum = 0;
-			PinCfg.Portnum = 0;
-			PINSEL_ConfigPin(&PinCfg);
-			PinCfg.Pinnum = 1;
-			PINSEL_ConfigPin(&PinCfg);
-			break;
-		}
-		default: {
-			return(vtI2CErrInit);
-			break;
-		}
+	if ((i2cDevNum >= 3) || (devStaticPtr[i2cDevNum] != NULL) || (isrHook[i2cDevNum].isr != NULL)) {
+		return(vtI2CErrInit);
 	}
+	devStaticPtr[i2cDevNum] = devPtr; // Setup the permanent variable for use by the interrupt handler
+	devPtr->devAddr = vtI2CHw[i2cDevNum].devAddr;
+	// Start with the interrupts disabled *and* make sure we have the priority correct
+	NVIC_SetPriority(vtI2CHw[i2cDevNum].irq,vtI2CIntPriority);	
+	NVIC_DisableIRQ(vtI2CHw[i2cDevNum].irq);
+	// Init I2C pin connect
+	vtI2CConfigPins(i2cDevNum,vtI2CHw[i2cDevNum].pinFunc);
 
 	// Create semaphore to communicate with interrupt handler
 	vSemaphoreCreateBinary(devPtr->binSemaphore);
@@ -115,17 +148,44 @@ int vtI2CInit(vtI2CStruct *devPtr,uint8_t i2cDevNum,unsigned portBASE_TYPE taskP
 	}
 
 	// Allocate the two queues to be used to communicate with other tasks
-	if ((devPtr->inQ = xQueueCreate(vtI2CQLen,sizeof(vtI2CMsg))) == NULL) {
+	if ((devPtr->inQ = xQueueCreate(vtI2CQLen,sizeof(vtI2CMsg *))) == NULL) {
+		// free up everyone and go home
+		vQueueDelete(devPtr->binSemaphore);
+		return(vtI2CErrInit);
+	}
+	if ((devPtr->inQHi = xQueueCreate(vtI2CQLen,sizeof(vtI2CMsg *))) == NULL) {
 		// free up everyone and go home
 		vQueueDelete(devPtr->binSemaphore);
+		vQueueDelete(devPtr->inQ);
 		return(vtI2CErrInit);
 	}
-	if ((devPtr->outQ = xQueueCreate(vtI2CQLen,sizeof(vtI2CMsg))) == NULL) {
+	if ((devPtr->outQ = xQueueCreate(vtI2CQLen,sizeof(vtI2CMsg *))) == NULL) {
 		// free up everyone and go home
 		vQueueDelete(devPtr->binSemaphore);
+		vQueueDelete(devPtr->inQ);
+		vQueueDelete(devPtr->inQHi);
+		return(vtI2CErrInit);
+	}
+	// Allocate the queue that holds the free descriptors and fill it with the whole pool
+	if ((devPtr->freeQ = xQueueCreate(vtI2CPoolLen,sizeof(vtI2CMsg *))) == NULL) {
+		// free up everyone and go home
+		vQueueDelete(devPtr->binSemaphore);
+		vQueueDelete(devPtr->inQ);
+		vQueueDelete(devPtr->inQHi);
 		vQueueDelete(devPtr->outQ);
 		return(vtI2CErrInit);
 	}
+	// and the doorbell that wakes up the I2C task (it starts out taken)
+	vSemaphoreCreateBinary(devPtr->doorbell);
+	if ((devPtr->doorbell == NULL) || (xSemaphoreTake(devPtr->doorbell,0) != pdTRUE)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	for (i=0;i<vtI2CPoolLen;i++) {
+		vtI2CMsg *msg = &(devPtr->pool[i]);
+		if (xQueueSend(devPtr->freeQ,(void *) (&msg),0) != pdTRUE) {
+			VT_HANDLE_FATAL_ERROR(0);
+		}
+	}
 
 	// Initialize  I2C peripheral
 	I2C_Init(devPtr->devAddr, i2cSpeed);
@@ -144,123 +204,1423 @@ int vtI2CInit(vtI2CStruct *devPtr,uint8_t i2cDevNum,unsigned portBASE_TYPE taskP
 	}
 }
 
-// A simple routine to use for filling out and sending a message to the I2C thread
-//   You may want to make your own versions of these as they are not suited to all purposes
-portBASE_TYPE vtI2CEnQ(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen)
+// Fill out a descriptor and send it to the I2C thread (used by all of the vtI2CEnQ() variants)
+static portBASE_TYPE vtI2CEnQTarget(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen,xQueueHandle replyQ,vtI2CCallback callback,void *cbArg)
 {
-	vtI2CMsg msgBuf;
+	vtI2CMsg *msgPtr;
 	int i;
 
-    msgBuf.slvAddr = slvAddr;
-	msgBuf.msgType = msgType;
-	msgBuf.rxLen = rxLen;
-	if (msgBuf.rxLen > vtI2CMLen) {
+	if (rxLen > vtI2CMLen) {
 		VT_HANDLE_FATAL_ERROR(0);
 	}
-	msgBuf.txLen = txLen;
-	if (msgBuf.txLen > vtI2CMLen) {
+	if (txLen > vtI2CTxMLen) {
 		VT_HANDLE_FATAL_ERROR(0);
 	}
-	for (i=0;i<msgBuf.txLen;i++) {
-		msgBuf.buf[i] = txBuf[i];
+	if ((msgPtr = vtI2CMsgGet(dev,portMAX_DELAY)) == NULL) {
+		return(pdFALSE);
+	}
+	msgPtr->slvAddr = slvAddr;
+	msgPtr->msgType = msgType;
+	msgPtr->rxLen = rxLen;
+	msgPtr->txLen = txLen;
+	for (i=0;i<msgPtr->txLen;i++) {
+		msgPtr->txBuf[i] = txBuf[i];
+	}
+	msgPtr->replyQ = replyQ;
+	msgPtr->callback = callback;
+	msgPtr->cbArg = cbArg;
+	return(vtI2CMsgSubmit(dev,msgPtr,portMAX_DELAY));
+}
+
+// A simple routine to use for filling out and sending a message to the I2C thread
+//   You may want to make your own versions of these as they are not suited to all purposes
+portBASE_TYPE vtI2CEnQ(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen)
+{
+	return(vtI2CEnQTarget(dev,msgType,slvAddr,txLen,txBuf,rxLen,NULL,NULL,NULL));
+}
+
+portBASE_TYPE vtI2CEnQReply(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen,xQueueHandle replyQ)
+{
+	return(vtI2CEnQTarget(dev,msgType,slvAddr,txLen,txBuf,rxLen,replyQ,NULL,NULL));
+}
+
+portBASE_TYPE vtI2CEnQCallback(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen,vtI2CCallback callback,void *cbArg)
+{
+	return(vtI2CEnQTarget(dev,msgType,slvAddr,txLen,txBuf,rxLen,NULL,callback,cbArg));
+}
+
+portBASE_TYPE vtI2CEnQProgram(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,const uint8_t *prog,vtI2CCallback callback,void *cbArg)
+{
+	vtI2CMsg *msgPtr;
+
+	if ((msgPtr = vtI2CMsgGet(dev,portMAX_DELAY)) == NULL) {
+		return(pdFALSE);
 	}
-	return(xQueueSend(dev->inQ,(void *) (&msgBuf),portMAX_DELAY));
+	msgPtr->slvAddr = slvAddr;
+	msgPtr->msgType = msgType;
+	msgPtr->prog = prog;
+	msgPtr->callback = callback;
+	msgPtr->cbArg = cbArg;
+	return(vtI2CMsgSubmit(dev,msgPtr,portMAX_DELAY));
 }
 
 // A simple routine to use for retrieving a message from the I2C thread
 portBASE_TYPE vtI2CDeQ(vtI2CStruct *dev,uint8_t maxRxLen,uint8_t *rxBuf,uint8_t *rxLen,uint8_t *msgType,uint8_t *status)
 {
-	vtI2CMsg msgBuf;
+	vtI2CMsg *msgPtr;
+	int i, len;
+
+	if (vtI2CMsgWait(dev,&msgPtr,portMAX_DELAY) != pdTRUE) {
+		return(pdFALSE);
+	}
+	(*status) = msgPtr->status;
+	(*rxLen) = msgPtr->rxLen;
+	len = msgPtr->rxLen;
+	if (len > maxRxLen) len = maxRxLen;
+	for (i=0;i<len;i++) {
+		rxBuf[i] = msgPtr->rxBuf[i];
+	}
+	(*msgType) = msgPtr->msgType;
+	vtI2CMsgRelease(dev,msgPtr);
+	return(pdTRUE);
+}
+
+vtI2CMsg *vtI2CMsgGet(vtI2CStruct *dev,portTickType ticksToBlock)
+{
+	vtI2CMsg *msgPtr;
+
+	if (xQueueReceive(dev->freeQ,(void *) (&msgPtr),ticksToBlock) != pdTRUE) {
+		return(NULL);
+	}
+	msgPtr->txLen = 0;
+	msgPtr->rxLen = 0;
+	msgPtr->status = 0;
+	msgPtr->segCount = 0;
+	msgPtr->timeout = 0;
+	msgPtr->priority = vtI2CPrioNormal;
+	msgPtr->noCoalesce = 0;
+	msgPtr->prog = NULL;
+	msgPtr->replyQ = NULL;
+	msgPtr->callback = NULL;
+	msgPtr->cbArg = NULL;
+	return(msgPtr);
+}
+
+portBASE_TYPE vtI2CMsgAddSeg(vtI2CMsg *msg,uint8_t op,uint8_t len,const uint8_t *txData)
+{
 	int i;
 
-	if (xQueueReceive(dev->outQ,(void *) (&msgBuf),portMAX_DELAY) != pdTRUE) {
+	if (msg->segCount >= vtI2CMaxSegs) {
 		return(pdFALSE);
 	}
-	(*status) = msgBuf.status;
-	(*rxLen) = msgBuf.rxLen;
-	if (msgBuf.rxLen > maxRxLen) msgBuf.rxLen = maxRxLen;
-	for (i=0;i<msgBuf.rxLen;i++) {
-		rxBuf[i] = msgBuf.buf[i];
+	switch (op) {
+		case vtI2CSegWrite: {
+			if (msg->txLen + len > vtI2CTxMLen) {
+				return(pdFALSE);
+			}
+			if (txData != NULL) {
+				for (i=0;i<len;i++) {
+					msg->txBuf[msg->txLen+i] = txData[i];
+				}
+			}
+			msg->txLen += len;
+			break;
+		}
+		case vtI2CSegRead: {
+			if ((len == 0) || (msg->rxLen + len > vtI2CMLen)) {
+				return(pdFALSE);
+			}
+			msg->rxLen += len;
+			break;
+		}
+		case vtI2CSegRestart:
+		case vtI2CSegStop: {
+			len = 0;
+			break;
+		}
+		default: {
+			return(pdFALSE);
+		}
 	}
-	(*msgType) = msgBuf.msgType;
+	msg->seg[msg->segCount].op = op;
+	msg->seg[msg->segCount].len = len;
+	msg->segCount++;
 	return(pdTRUE);
 }
 
+// Check the segments of a compound transaction: there must be something to send or receive, and every read must be
+//   at least one byte long (the master has to take at least one byte once a slave answers a read)
+static portBASE_TYPE vtI2CSegsValid(vtI2CMsg *msg)
+{
+	int i;
+	uint8_t any = 0;
+
+	if (msg->segCount == 0) {
+		return(pdTRUE);
+	}
+	for (i=0;i<msg->segCount;i++) {
+		switch (msg->seg[i].op) {
+			case vtI2CSegWrite: {
+				any = 1;
+				break;
+			}
+			case vtI2CSegRead: {
+				if (msg->seg[i].len == 0) return(pdFALSE);
+				any = 1;
+				break;
+			}
+			case vtI2CSegRestart:
+			case vtI2CSegStop: {
+				break;
+			}
+			default: {
+				return(pdFALSE);
+			}
+		}
+	}
+	return(any ? pdTRUE : pdFALSE);
+}
+
+// Check that an I2C program only has known opcodes with sensible arguments and that it ends
+static portBASE_TYPE vtI2CProgValid(const uint8_t *prog)
+{
+	uint8_t inLoop = 0;
+
+	for (;;) {
+		switch (prog[0]) {
+			case vtI2COpEnd: {
+				return(inLoop ? pdFALSE : pdTRUE);
+			}
+			case vtI2COpWrite: {
+				if (prog[1] > vtI2CTxMLen) return(pdFALSE);
+				prog += 2 + prog[1];
+				break;
+			}
+			case vtI2COpRead: {
+				if ((prog[1] == 0) || (prog[1] > vtI2CMLen)) return(pdFALSE);
+				prog += 2;
+				break;
+			}
+			case vtI2COpDelay: {
+				prog += 2;
+				break;
+			}
+			case vtI2COpPoll: {
+				if (prog[4] == 0) return(pdFALSE);
+				prog += 6;
+				break;
+			}
+			case vtI2COpLoop: {
+				if (inLoop || (prog[1] == 0)) return(pdFALSE);
+				inLoop = 1;
+				prog += 2;
+				break;
+			}
+			case vtI2COpNext: {
+				if (!inLoop) return(pdFALSE);
+				inLoop = 0;
+				prog++;
+				break;
+			}
+			case vtI2COpDeliver: {
+				prog++;
+				break;
+			}
+			default: {
+				return(pdFALSE);
+			}
+		}
+	}
+}
+
+portBASE_TYPE vtI2CMsgSubmit(vtI2CStruct *dev,vtI2CMsg *msg,portTickType ticksToBlock)
+{
+	if ((msg->rxLen > vtI2CMLen) || (msg->txLen > vtI2CTxMLen)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	if ((msg->segCount > vtI2CMaxSegs) || (vtI2CSegsValid(msg) != pdTRUE)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	if (msg->priority >= vtI2CNumPrio) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	if ((msg->prog != NULL) && ((msg->segCount != 0) || (vtI2CProgValid(msg->prog) != pdTRUE))) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	msg->tEnq = portGET_RUN_TIME_COUNTER_VALUE();
+	msg->cEnq = vtCycleCount();
+	if (xQueueSend((msg->priority == vtI2CPrioHigh) ? dev->inQHi : dev->inQ,(void *) (&msg),ticksToBlock) != pdTRUE) {
+		return(pdFALSE);
+	}
+	// Ring the doorbell after the message is on the queue, so the I2C task cannot miss it
+	xSemaphoreGive(dev->doorbell);
+	return(pdTRUE);
+}
+
+portBASE_TYPE vtI2CMsgWait(vtI2CStruct *dev,vtI2CMsg **msg,portTickType ticksToBlock)
+{
+	return(xQueueReceive(dev->outQ,(void *) msg,ticksToBlock));
+}
+
+void vtI2CMsgRelease(vtI2CStruct *dev,vtI2CMsg *msg)
+{
+	// Catch pointers that did not come from this pool (they would corrupt it)
+	if ((msg < &(dev->pool[0])) || (msg > &(dev->pool[vtI2CPoolLen-1]))) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	// This cannot block -- there is always room for every descriptor in the pool
+	if (xQueueSend(dev->freeQ,(void *) (&msg),0) != pdTRUE) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+}
+
+// Record that a device is on an I2C peripheral (used by vtI2CReserveDevice() and vtI2CPlaceDevice())
+static int vtI2CAddDevice(vtI2CStruct *dev,uint8_t slvAddr,uint32_t load)
+{
+	uint32_t mask = 1UL << (slvAddr & 0x1F);
+
+	if (slvAddr > 0x7F) {
+		return(vtI2CErrPlace);
+	}
+	if (dev->placedAddr[slvAddr >> 5] & mask) {
+		// two devices with the same address cannot share a bus
+		return(vtI2CErrPlace);
+	}
+	dev->placedAddr[slvAddr >> 5] |= mask;
+	dev->placedLoad += load;
+	return(vtI2CPlaceSuccess);
+}
+
+int vtI2CAttachIsr(uint8_t i2cDevNum,vtI2CIsrHook isr,void *arg)
+{
+	if ((i2cDevNum >= 3) || (devStaticPtr[i2cDevNum] != NULL) || (isrHook[i2cDevNum].isr != NULL) || (isr == NULL)) {
+		return(vtI2CErrInit);
+	}
+	NVIC_SetPriority(vtI2CHw[i2cDevNum].irq,vtI2CIntPriority);	
+	NVIC_DisableIRQ(vtI2CHw[i2cDevNum].irq);
+	isrHook[i2cDevNum].arg = arg;
+	isrHook[i2cDevNum].isr = isr;
+	vtI2CConfigPins(i2cDevNum,vtI2CHw[i2cDevNum].pinFunc);
+	// The clock rate only matters when acting as a master
+	I2C_Init(vtI2CHw[i2cDevNum].devAddr,100000);
+	I2C_Cmd(vtI2CHw[i2cDevNum].devAddr,ENABLE);
+	NVIC_EnableIRQ(vtI2CHw[i2cDevNum].irq);
+	return(vtI2CInitSuccess);
+}
+
+int vtI2CReserveDevice(vtI2CStruct *dev,uint8_t slvAddr,uint32_t load)
+{
+	return(vtI2CAddDevice(dev,slvAddr,load));
+}
+
+vtI2CStruct *vtI2CPlaceDevice(uint8_t slvAddr,uint32_t load)
+{
+	vtI2CStruct *best = NULL;
+	int i;
+
+	if (slvAddr > 0x7F) {
+		return(NULL);
+	}
+	// Pick the initialized I2C peripheral with the least load that does not already have a device at this address
+	for (i=0;i<3;i++) {
+		vtI2CStruct *dev = devStaticPtr[i];
+		if (dev == NULL) continue;
+		if (dev->placedAddr[slvAddr >> 5] & (1UL << (slvAddr & 0x1F))) continue;
+		if ((best == NULL) || (dev->placedLoad < best->placedLoad)) {
+			best = dev;
+		}
+	}
+	if (best != NULL) {
+		vtI2CAddDevice(best,slvAddr,load);
+	}
+	return(best);
+}
+
+portBASE_TYPE vtI2CGetSlaveStats(vtI2CStruct *dev,uint8_t idx,vtI2CSlaveStats *stats)
+{
+	portBASE_TYPE found = pdFALSE;
+
+	taskENTER_CRITICAL();
+	if (idx < dev->slaveCount) {
+		(*stats) = dev->slaveStats[idx];
+		found = pdTRUE;
+	}
+	taskEXIT_CRITICAL();
+	return(found);
+}
+
+void vtI2CSetCoalesce(vtI2CStruct *dev,portTickType window)
+{
+	int i;
+
+	taskENTER_CRITICAL();
+	dev->coalesceWindow = window;
+	// do not hand out anything that was cached under an older setting
+	for (i=0;i<vtI2CCacheLen;i++) {
+		dev->cache[i].valid = 0;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void vtI2CGetCoalesceCounts(vtI2CStruct *dev,uint32_t *coalesced,uint32_t *cacheHits)
+{
+	taskENTER_CRITICAL();
+	(*coalesced) = dev->coalesced;
+	(*cacheHits) = dev->cacheHits;
+	taskEXIT_CRITICAL();
+}
+
+void vtI2CGetLatency(vtI2CStruct *dev,uint8_t priority,vtI2CLatency *latency)
+{
+	if (priority >= vtI2CNumPrio) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	taskENTER_CRITICAL();
+	(*latency) = dev->latency[priority];
+	taskEXIT_CRITICAL();
+}
+
+void vtI2CGetErrorCounts(vtI2CStruct *dev,uint32_t *timeouts,uint32_t *recoveries)
+{
+	taskENTER_CRITICAL();
+	(*timeouts) = dev->timeouts;
+	(*recoveries) = dev->recoveries;
+	taskEXIT_CRITICAL();
+}
+
+portBASE_TYPE vtI2CPollStart(vtI2CStruct *dev,vtI2CPollJob *job)
+{
+	int i;
+
+	if ((job->txLen > vtI2CTxMLen) || (job->rxLen > vtI2CMLen) || (job->priority >= vtI2CNumPrio)) {
+		VT_HANDLE_FATAL_ERROR(0);
+	}
+	job->nextDue = xTaskGetTickCount();
+	job->missed = 0;
+	taskENTER_CRITICAL();
+	for (i=0;i<vtI2CMaxPollJobs;i++) {
+		if (dev->poll[i] == NULL) {
+			dev->poll[i] = job;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	if (i == vtI2CMaxPollJobs) {
+		return(pdFALSE);
+	}
+	// Wake up the I2C task so that it takes the new job into account
+	xSemaphoreGive(dev->doorbell);
+	return(pdTRUE);
+}
+
+void vtI2CPollStop(vtI2CStruct *dev,vtI2CPollJob *job)
+{
+	int i;
+
+	taskENTER_CRITICAL();
+	for (i=0;i<vtI2CMaxPollJobs;i++) {
+		if (dev->poll[i] == job) {
+			dev->poll[i] = NULL;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+portBASE_TYPE vtI2CPollFromISR(vtI2CStruct *dev,vtI2CPollJob *job,signed portBASE_TYPE *pxHigherPriorityTaskWoken)
+{
+	uint32_t stamp = portGET_RUN_TIME_COUNTER_VALUE();
+	uint32_t cycles = vtCycleCount();
+	xQueueHandle q = (job->priority == vtI2CPrioHigh) ? dev->inQHi : dev->inQ;
+	vtI2CMsg *msgPtr;
+	int i;
+
+	if (xQueueReceiveFromISR(dev->freeQ,(void *) (&msgPtr),pxHigherPriorityTaskWoken) != pdTRUE) {
+		job->missed++;
+		return(pdFALSE);
+	}
+	msgPtr->msgType = job->msgType;
+	msgPtr->slvAddr = job->slvAddr;
+	msgPtr->txLen = job->txLen;
+	for (i=0;i<job->txLen;i++) {
+		msgPtr->txBuf[i] = job->txBuf[i];
+	}
+	msgPtr->rxLen = job->rxLen;
+	msgPtr->status = 0;
+	msgPtr->segCount = 0;
+	msgPtr->timeout = 0;
+	msgPtr->priority = job->priority;
+	msgPtr->noCoalesce = 1;
+	msgPtr->prog = NULL;
+	msgPtr->replyQ = job->replyQ;
+	msgPtr->callback = job->callback;
+	msgPtr->cbArg = job->cbArg;
+	msgPtr->tEnq = stamp;
+	msgPtr->cEnq = cycles;
+	if (xQueueSendFromISR(q,(void *) (&msgPtr),pxHigherPriorityTaskWoken) != pdTRUE) {
+		// cannot happen with a descriptor from the pool (the queue has room for all of them), but just in case
+		xQueueSendFromISR(dev->freeQ,(void *) (&msgPtr),pxHigherPriorityTaskWoken);
+		job->missed++;
+		return(pdFALSE);
+	}
+	xSemaphoreGiveFromISR(dev->doorbell,pxHigherPriorityTaskWoken);
+	return(pdTRUE);
+}
 // End of public API Functions
 /* ************************************************ */
 
-// i2c interrupt handler
-static __INLINE void vtI2CIsr(LPC_I2C_TypeDef *devAddr,xSemaphoreHandle *binSemaphore) {
-	I2C_MasterHandler(devAddr);
-	if (I2C_MasterTransferComplete(devAddr)) {
+// The I2C master interrupt handler
+//   This works straight on the ring of the I2C peripheral: the transaction at ringTail is the one on the bus.  Each status
+//   code of the I2C peripheral (a multiple of 8) has its own handler in a table, so there is no searching for the code and
+//   no per-byte work beyond the data itself.
+//
+// phaseFlags
+#define vtI2CPhaseRead 0x01			// Data goes from the slave to us
+#define vtI2CPhaseStop 0x02			// Comes after a stop and a start instead of a repeated start
+// I2CONSET/I2CONCLR bits
+#define vtI2CSTA I2C_I2CONSET_STA
+#define vtI2CSTO I2C_I2CONSET_STO
+#define vtI2CAA I2C_I2CONSET_AA
+
+// Break a transaction down into phases (see vtI2CMsg) -- runs of writes or of reads with no restart or stop in between
+//   are put together, since they go out as one
+static void vtI2CPlanMsg(vtI2CMsg *msgPtr)
+{
+	uint8_t i, n = 0, flags, brk = 1, stop = 0;
+
+	if (msgPtr->segCount == 0) {
+		// a plain write-then-read (a write of nothing just checks that the slave is there)
+		if ((msgPtr->txLen > 0) || (msgPtr->rxLen == 0)) {
+			msgPtr->phaseLen[n] = msgPtr->txLen;
+			msgPtr->phaseFlags[n++] = 0;
+		}
+		if (msgPtr->rxLen > 0) {
+			msgPtr->phaseLen[n] = msgPtr->rxLen;
+			msgPtr->phaseFlags[n++] = vtI2CPhaseRead;
+		}
+	} else {
+		for (i=0;i<msgPtr->segCount;i++) {
+			switch (msgPtr->seg[i].op) {
+				case vtI2CSegWrite:
+				case vtI2CSegRead: {
+					flags = (msgPtr->seg[i].op == vtI2CSegRead) ? vtI2CPhaseRead : 0;
+					if (!brk && ((msgPtr->phaseFlags[n-1] & vtI2CPhaseRead) == flags)) {
+						msgPtr->phaseLen[n-1] += msgPtr->seg[i].len;
+					} else {
+						msgPtr->phaseLen[n] = msgPtr->seg[i].len;
+						msgPtr->phaseFlags[n++] = flags | (stop ? vtI2CPhaseStop : 0);
+					}
+					brk = stop = 0;
+					break;
+				}
+				case vtI2CSegStop: {
+					// (a stop before the first phase means nothing)
+					stop = (n > 0);
+					brk = 1;
+					break;
+				}
+				default: {
+					brk = 1;
+					break;
+				}
+			}
+		}
+	}
+	msgPtr->phaseCount = n;
+}
+
+// Get a transaction ready to go on the bus (the start condition is up to the caller)
+static void vtI2CPrepMsg(vtI2CMsg *msgPtr)
+{
+	vtI2CPlanMsg(msgPtr);
+	msgPtr->phase = 0;
+	msgPtr->left = msgPtr->phaseLen[0];
+	msgPtr->grpPhase = 0;
+	msgPtr->grpTx = 0;
+	msgPtr->grpRx = 0;
+	msgPtr->txPos = 0;
+	msgPtr->rxPos = 0;
+	msgPtr->retries = 0;
+	msgPtr->tStart = vtCycleCount();
+}
+
+// Put the first transaction of a batch on the bus (called from the I2C task, while the interrupt handler is idle)
+static void vtI2CStartMsg(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	vtI2CPrepMsg(msgPtr);
+	NVIC_EnableIRQ(vtI2CHw[devPtr->devNum].irq);
+	devPtr->devAddr->I2CONCLR = I2C_I2CONCLR_SIC | I2C_I2CONCLR_STAC | I2C_I2CONCLR_AAC;
+	devPtr->devAddr->I2CONSET = vtI2CSTA;
+}
+
+// Fill in the results of a transaction that has come off the bus
+static void vtI2CMsgDone(vtI2CMsg *msgPtr,uint8_t status)
+{
+	uint8_t txCount = msgPtr->txPos;
+	uint8_t rxCount = msgPtr->rxPos;
+	uint8_t i, n;
+
+	msgPtr->status = status;
+	msgPtr->txLen = txCount;
+	msgPtr->rxLen = rxCount;
+	// Hand the byte counts out to the segments in order (whatever did not get done gets 0)
+	for (i=0;i<msgPtr->segCount;i++) {
+		if (msgPtr->seg[i].op == vtI2CSegWrite) {
+			n = (msgPtr->seg[i].len < txCount) ? msgPtr->seg[i].len : txCount;
+			msgPtr->seg[i].len = n;
+			txCount -= n;
+		} else if (msgPtr->seg[i].op == vtI2CSegRead) {
+			n = (msgPtr->seg[i].len < rxCount) ? msgPtr->seg[i].len : rxCount;
+			msgPtr->seg[i].len = n;
+			rxCount -= n;
+		}
+	}
+	msgPtr->tDone = vtCycleCount();
+}
+
+// The transaction on the bus is over: stop, and start the next one in the ring right away so that the bus does not
+//   sit idle while the I2C task is woken up; the task is only woken up once the ring is empty
+static void vtI2CEndMsg(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr,uint8_t status)
+{
+	vtI2CMsgDone(msgPtr,status);
+	devPtr->ringTail++;
+	if (devPtr->ringTail != devPtr->ringHead) {
+		vtI2CPrepMsg(devPtr->ring[devPtr->ringTail & vtI2CRingMask]);
+		// the peripheral sends the stop and then a start
+		i2c->I2CONSET = vtI2CSTO | vtI2CSTA;
+		i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+	} else {
 		static signed portBASE_TYPE xHigherPriorityTaskWoken;
+		i2c->I2CONSET = vtI2CSTO;
+		i2c->I2CONCLR = I2C_I2CONCLR_SIC;
 		xHigherPriorityTaskWoken = pdFALSE;
-		xSemaphoreGiveFromISR(*binSemaphore,&xHigherPriorityTaskWoken);
+		xSemaphoreGiveFromISR(devPtr->binSemaphore,&xHigherPriorityTaskWoken);
 		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 	}
 }
+
+// Move on to the next phase (or finish the transaction)
+static void vtI2CNextPhase(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	msgPtr->phase++;
+	if (msgPtr->phase == msgPtr->phaseCount) {
+		vtI2CEndMsg(devPtr,i2c,msgPtr,vtI2CStatusOk);
+		return;
+	}
+	msgPtr->left = msgPtr->phaseLen[msgPtr->phase];
+	if (msgPtr->phaseFlags[msgPtr->phase] & vtI2CPhaseStop) {
+		// this is as far back as a retry has to go
+		msgPtr->grpPhase = msgPtr->phase;
+		msgPtr->grpTx = msgPtr->txPos;
+		msgPtr->grpRx = msgPtr->rxPos;
+		i2c->I2CONSET = vtI2CSTO | vtI2CSTA;
+	} else {
+		i2c->I2CONSET = vtI2CSTA;
+	}
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// The slave did not answer, or we lost the bus to another master: start over from the last start condition, or give up
+static void vtI2CRetry(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr,uint32_t conset)
+{
+	if (msgPtr->retries >= vtI2CTries-1) {
+		vtI2CEndMsg(devPtr,i2c,msgPtr,vtI2CStatusError);
+		return;
+	}
+	msgPtr->retries++;
+	msgPtr->phase = msgPtr->grpPhase;
+	msgPtr->left = msgPtr->phaseLen[msgPtr->grpPhase];
+	msgPtr->txPos = msgPtr->grpTx;
+	msgPtr->rxPos = msgPtr->grpRx;
+	i2c->I2CONSET = conset;
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// Handlers for each status code
+typedef void (*vtI2CStateFn)(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr);
+
+// 0x08, 0x10: start/repeated start sent -- send the address
+static void vtI2CStateStart(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	i2c->I2DAT = (msgPtr->slvAddr << 1) | (msgPtr->phaseFlags[msgPtr->phase] & vtI2CPhaseRead);
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC | I2C_I2CONCLR_STAC;
+}
+
+// 0x18, 0x28: address or data byte acknowledged -- send the next byte
+static void vtI2CStateTxAck(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	if (msgPtr->left == 0) {
+		vtI2CNextPhase(devPtr,i2c,msgPtr);
+		return;
+	}
+	i2c->I2DAT = msgPtr->txBuf[msgPtr->txPos++];
+	msgPtr->left--;
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// 0x20, 0x48: address not acknowledged
+static void vtI2CStateAddrNack(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	vtI2CRetry(devPtr,i2c,msgPtr,vtI2CSTO | vtI2CSTA);
+}
+
+// 0x30: data byte not acknowledged (so it does not count as sent)
+static void vtI2CStateTxNack(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	msgPtr->txPos--;
+	vtI2CRetry(devPtr,i2c,msgPtr,vtI2CSTO | vtI2CSTA);
+}
+
+// 0x38: lost the bus to another master -- a start goes out as soon as the bus is free again
+static void vtI2CStateArbLost(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	vtI2CRetry(devPtr,i2c,msgPtr,vtI2CSTA);
+}
+
+// 0x40: address for a read acknowledged -- acknowledge every byte but the last
+static void vtI2CStateRxAddrAck(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	if (msgPtr->left > 1) {
+		i2c->I2CONSET = vtI2CAA;
+	} else {
+		i2c->I2CONCLR = I2C_I2CONCLR_AAC;
+	}
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// 0x50: data byte received and acknowledged
+static void vtI2CStateRxAck(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	msgPtr->rxBuf[msgPtr->rxPos++] = i2c->I2DAT;
+	msgPtr->left--;
+	if (msgPtr->left > 1) {
+		i2c->I2CONSET = vtI2CAA;
+	} else {
+		i2c->I2CONCLR = I2C_I2CONCLR_AAC;
+	}
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// 0x58: last data byte received (and not acknowledged, to tell the slave we are done)
+static void vtI2CStateRxLast(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	msgPtr->rxBuf[msgPtr->rxPos++] = i2c->I2DAT;
+	msgPtr->left = 0;
+	vtI2CNextPhase(devPtr,i2c,msgPtr);
+}
+
+// 0x00: illegal start or stop on the bus -- let go of it and give up on the transaction
+static void vtI2CStateBusError(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	vtI2CEndMsg(devPtr,i2c,msgPtr,vtI2CStatusError);
+}
+
+// Anything else (slave mode codes, which we never enable, and 0xF8, which never interrupts)
+static void vtI2CStateOther(vtI2CStruct *devPtr,LPC_I2C_TypeDef *i2c,vtI2CMsg *msgPtr)
+{
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// Indexed by the status code divided by 8
+static const vtI2CStateFn vtI2CStateTable[32] = {
+	vtI2CStateBusError,		// 0x00
+	vtI2CStateStart,		// 0x08
+	vtI2CStateStart,		// 0x10
+	vtI2CStateTxAck,		// 0x18
+	vtI2CStateAddrNack,		// 0x20
+	vtI2CStateTxAck,		// 0x28
+	vtI2CStateTxNack,		// 0x30
+	vtI2CStateArbLost,		// 0x38
+	vtI2CStateRxAddrAck,	// 0x40
+	vtI2CStateAddrNack,		// 0x48
+	vtI2CStateRxAck,		// 0x50
+	vtI2CStateRxLast,		// 0x58
+	vtI2CStateOther, vtI2CStateOther, vtI2CStateOther, vtI2CStateOther,		// 0x60-0x78
+	vtI2CStateOther, vtI2CStateOther, vtI2CStateOther, vtI2CStateOther,		// 0x80-0x98
+	vtI2CStateOther, vtI2CStateOther, vtI2CStateOther, vtI2CStateOther,		// 0xA0-0xB8
+	vtI2CStateOther, vtI2CStateOther, vtI2CStateOther, vtI2CStateOther,		// 0xC0-0xD8
+	vtI2CStateOther, vtI2CStateOther, vtI2CStateOther, vtI2CStateOther,		// 0xE0-0xF8
+};
+
+// i2c interrupt handler
+static __INLINE void vtI2CIsr(vtI2CStruct *devPtr) {
+	LPC_I2C_TypeDef *i2c = devPtr->devAddr;
+	vtI2CStateTable[(i2c->I2STAT >> 3) & 0x1F](devPtr,i2c,devPtr->ring[devPtr->ringTail & vtI2CRingMask]);
+}
+
 // Simply pass on the information to the real interrupt handler above (have to do this to work for multiple i2c peripheral units on the LPC1768
 void vtI2C0Isr(void) {
-	// Log the I2C status code
-	vtITMu8(vtITMPortI2C0IntHandler,((devStaticPtr[0]->devAddr)->I2STAT & I2C_STAT_CODE_BITMASK));
-	vtI2CIsr(devStaticPtr[0]->devAddr,&(devStaticPtr[0]->binSemaphore));
+	if (isrHook[0].isr != NULL) {
+		isrHook[0].isr(isrHook[0].arg);
+		return;
+	}
+	vtI2CIsr(devStaticPtr[0]);
 }
 
 // Simply pass on the information to the real interrupt handler above (have to do this to work for multiple i2c peripheral units on the LPC1768
 void vtI2C1Isr(void) {
-	// Log the I2C status code
-	vtITMu8(vtITMPortI2C1IntHandler,((devStaticPtr[1]->devAddr)->I2STAT & I2C_STAT_CODE_BITMASK));
-	vtI2CIsr(devStaticPtr[1]->devAddr,&(devStaticPtr[1]->binSemaphore));
+	if (isrHook[1].isr != NULL) {
+		isrHook[1].isr(isrHook[1].arg);
+		return;
+	}
+	vtI2CIsr(devStaticPtr[1]);
 }
 // Simply pass on the information to the real interrupt handler above (have to do this to work for multiple i2c peripheral units on the LPC1768
 void vtI2C2Isr(void) {
-	vtI2CIsr(devStaticPtr[2]->devAddr,&(devStaticPtr[2]->binSemaphore));
+	if (isrHook[2].isr != NULL) {
+		isrHook[2].isr(isrHook[2].arg);
+		return;
+	}
+	vtI2CIsr(devStaticPtr[2]);
+}
+
+
+// Hand a completed descriptor to whoever asked for it (called from the I2C task)
+static void vtI2CComplete(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	uint32_t lat = vtI2CCyclesToUs(vtCycleCount() - msgPtr->cEnq);
+	vtI2CLatency *latPtr = &(devPtr->latency[msgPtr->priority]);
+
+	taskENTER_CRITICAL();
+	latPtr->count++;
+	latPtr->total += lat;
+	if (lat > latPtr->max) latPtr->max = lat;
+	taskEXIT_CRITICAL();
+	if (msgPtr->callback != NULL) {
+		msgPtr->callback(msgPtr,msgPtr->cbArg);
+		vtI2CMsgRelease(devPtr,msgPtr);
+	} else {
+		xQueueHandle q = (msgPtr->replyQ != NULL) ? msgPtr->replyQ : devPtr->outQ;
+		if (xQueueSend(q,(void*)(&msgPtr),portMAX_DELAY) != pdTRUE) {
+			// something went wrong 
+			VT_HANDLE_FATAL_ERROR(0);
+		} 
+	}
+}
+
+// Connect the I2C pins to the given function (0 makes them plain GPIO)
+static void vtI2CConfigPins(uint8_t devNum,uint8_t func)
+{
+	PINSEL_CFG_Type PinCfg;
+
+	PinCfg.OpenDrain = vtI2CHw[devNum].pinOpenDrain;
+	PinCfg.Pinmode = 0;
+	PinCfg.Funcnum = func;
+	PinCfg.Portnum = 0;
+	PinCfg.Pinnum = vtI2CHw[devNum].sdaPin;
+	PINSEL_ConfigPin(&PinCfg);
+	PinCfg.Pinnum = vtI2CHw[devNum].sclPin;
+	PINSEL_ConfigPin(&PinCfg);
+}
+
+// How long a transaction may take: the time its bytes (plus address bytes) take on the bus for every try, plus some slack
+static portTickType vtI2CMsgDeadline(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	uint32_t bytes, ms;
+
+	if (msgPtr->timeout != 0) {
+		return(msgPtr->timeout);
+	}
+	bytes = msgPtr->txLen + msgPtr->rxLen + 2 + 2*msgPtr->segCount;
+	ms = (bytes * 9 * vtI2CTries * 1000) / devPtr->speed;
+	return(vtI2CTimeoutMinTicks + (ms / portTICK_RATE_MS));
+}
+
+// Wait for about half of an SCL period
+static void vtI2CBusClearWait(void)
+{
+	volatile int i;
+	for (i=0;i<vtI2CBusClearDelay;i++);
+}
+
+// Free up the bus after a transaction got stuck and put the I2C peripheral back into its start-up state
+//   A slave that was cut off in the middle of sending may be holding SDA low; clocking SCL (up to nine times) lets it
+//   finish its byte, and a stop condition then puts it back to idle
+static void vtI2CBusReset(vtI2CStruct *devPtr)
+{
+	uint32_t sda = (1 << vtI2CHw[devPtr->devNum].sdaPin);
+	uint32_t scl = (1 << vtI2CHw[devPtr->devNum].sclPin);
+	int i;
+
+	I2C_Cmd(devPtr->devAddr, DISABLE);
+	I2C_DeInit(devPtr->devAddr);
+	// Drive the pins by hand, open drain style: set the output to 0 and switch the direction to pull the line low
+	vtI2CConfigPins(devPtr->devNum,0);
+	LPC_GPIO0->FIOCLR = sda | scl;
+	LPC_GPIO0->FIODIR &= ~(sda | scl);
+	vtI2CBusClearWait();
+	if ((LPC_GPIO0->FIOPIN & sda) == 0) {
+		devPtr->recoveries++;
+		for (i=0;(i<9) && ((LPC_GPIO0->FIOPIN & sda) == 0);i++) {
+			LPC_GPIO0->FIODIR |= scl;
+			vtI2CBusClearWait();
+			LPC_GPIO0->FIODIR &= ~scl;
+			vtI2CBusClearWait();
+		}
+	}
+	// stop condition: SDA goes up while SCL is up
+	LPC_GPIO0->FIODIR |= scl;
+	vtI2CBusClearWait();
+	LPC_GPIO0->FIODIR |= sda;
+	vtI2CBusClearWait();
+	LPC_GPIO0->FIODIR &= ~scl;
+	vtI2CBusClearWait();
+	LPC_GPIO0->FIODIR &= ~sda;
+	vtI2CBusClearWait();
+	// and hand the pins back to the I2C peripheral
+	vtI2CConfigPins(devPtr->devNum,vtI2CHw[devPtr->devNum].pinFunc);
+	I2C_Init(devPtr->devAddr, devPtr->speed);
+	I2C_Cmd(devPtr->devAddr, ENABLE);
 }
 
+// Wait for the interrupt handler to run a batch, giving each transaction its own deadline
+//   A transaction that misses its deadline is failed with vtI2CStatusTimeout, the bus is reset, and the rest of the
+//   batch is started over from here
+static void vtI2CBatchWait(vtI2CStruct *devPtr)
+{
+	uint8_t tail;
+	vtI2CMsg *msgPtr;
+
+	for (;;) {
+		tail = devPtr->ringTail;
+		if (xSemaphoreTake(devPtr->binSemaphore,vtI2CMsgDeadline(devPtr,devPtr->ring[tail & vtI2CRingMask])) == pdTRUE) {
+			return;
+		}
+		if (devPtr->ringTail != tail) {
+			// the interrupt handler moved on to the next one, which gets its own deadline
+			continue;
+		}
+		// Stop the interrupt handler and check whether it finished after all
+		NVIC_DisableIRQ(vtI2CHw[devPtr->devNum].irq);
+		if (xSemaphoreTake(devPtr->binSemaphore,0) == pdTRUE) {
+			return;
+		}
+		if (devPtr->ringTail != tail) {
+			NVIC_EnableIRQ(vtI2CHw[devPtr->devNum].irq);
+			continue;
+		}
+		// Stuck -- give up on this transaction
+		msgPtr = devPtr->ring[tail & vtI2CRingMask];
+		vtI2CMsgDone(msgPtr,vtI2CStatusTimeout);
+		devPtr->timeouts++;
+		vtI2CBusReset(devPtr);
+		devPtr->ringTail = tail + 1;
+		if (devPtr->ringTail == devPtr->ringHead) {
+			return;
+		}
+		vtI2CStartMsg(devPtr,devPtr->ring[devPtr->ringTail & vtI2CRingMask]);
+	}
+}
+
+// Is tick "due" at or before tick "now"? (works across the wrap of the tick count)
+#define vtI2CTickReached(now,due) ((int32_t) ((now) - (due)) >= 0)
+// Most transactions that a back-to-back poll job (period 0) puts in one batch -- the rest of the batch is left for others
+#define vtI2CStreamSlots ((vtI2CChainLen+1)/2)
+
+// Put the poll jobs of one priority class that are due into the ring, as long as there is room in it and there are free descriptors
+//   Jobs that do not fit stay due and get in on the next batch
+// Return:
+//   Ticks until the next job (of any class) is due (portMAX_DELAY if there are no jobs)
+static portTickType vtI2CPollRun(vtI2CStruct *devPtr,uint8_t batchStart,uint8_t priority)
+{
+	portTickType now = xTaskGetTickCount();
+	portTickType wait = portMAX_DELAY;
+	vtI2CPollJob *job;
+	vtI2CMsg *msgPtr;
+	int i, j, k;
+
+	for (i=0;i<vtI2CMaxPollJobs;i++) {
+		if ((job = devPtr->poll[i]) == NULL) continue;
+		for (k=0;k<((job->period == 0) ? vtI2CStreamSlots : 1);k++) {
+			if (!vtI2CTickReached(now,job->nextDue) || (job->priority != priority) || ((uint8_t) (devPtr->ringHead - batchStart) >= vtI2CChainLen)) {
+				break;
+			}
+			if ((msgPtr = vtI2CMsgGet(devPtr,0)) != NULL) {
+				msgPtr->msgType = job->msgType;
+				msgPtr->slvAddr = job->slvAddr;
+				msgPtr->txLen = job->txLen;
+				for (j=0;j<job->txLen;j++) {
+					msgPtr->txBuf[j] = job->txBuf[j];
+				}
+				msgPtr->rxLen = job->rxLen;
+				msgPtr->replyQ = job->replyQ;
+				msgPtr->callback = job->callback;
+				msgPtr->cbArg = job->cbArg;
+				msgPtr->priority = job->priority;
+				msgPtr->tEnq = portGET_RUN_TIME_COUNTER_VALUE();
+				msgPtr->cEnq = vtCycleCount();
+				msgPtr->dupNext = NULL;
+				devPtr->ring[devPtr->ringHead & vtI2CRingMask] = msgPtr;
+				devPtr->ringHead++;
+				if (job->period == 0) {
+					// back-to-back: due again right away
+					job->nextDue = now;
+					continue;
+				}
+				// Stay on the original grid so that the samples do not drift, unless we are a full period behind
+				job->nextDue += job->period;
+				if (vtI2CTickReached(now,job->nextDue)) {
+					job->missed++;
+					job->nextDue = now + job->period;
+				}
+			} else {
+				break;
+			}
+		}
+		if (vtI2CTickReached(now,job->nextDue)) {
+			// still due (the ring is full or no descriptor is free), so look again as soon as something completes
+			wait = 0;
+		} else if ((job->nextDue - now) < wait) {
+			wait = job->nextDue - now;
+		}
+	}
+	return(wait);
+}
+
+// Read coalescing (see vtI2CSetCoalesce())
+//
+// Is this a read that may share its result?
+#define vtI2CCanCoalesce(msgPtr) (((msgPtr)->rxLen > 0) && ((msgPtr)->segCount == 0) && ((msgPtr)->prog == NULL) && !(msgPtr)->noCoalesce)
+
+// Does a read match the given slave, command and length?
+static portBASE_TYPE vtI2CSameRead(vtI2CMsg *msgPtr,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen)
+{
+	int i;
+
+	if ((msgPtr->slvAddr != slvAddr) || (msgPtr->txLen != txLen) || (msgPtr->rxLen != rxLen)) {
+		return(pdFALSE);
+	}
+	for (i=0;i<txLen;i++) {
+		if (msgPtr->txBuf[i] != txBuf[i]) return(pdFALSE);
+	}
+	return(pdTRUE);
+}
+
+// Find a read in the batch being put together that is identical to this one
+static vtI2CMsg *vtI2CFindLeader(vtI2CStruct *devPtr,uint8_t batchStart,vtI2CMsg *msgPtr)
+{
+	vtI2CMsg *other;
+	uint8_t idx;
+
+	if (!vtI2CCanCoalesce(msgPtr)) return(NULL);
+	for (idx=batchStart;idx!=devPtr->ringHead;idx++) {
+		other = devPtr->ring[idx & vtI2CRingMask];
+		if (vtI2CCanCoalesce(other) && (other->priority == msgPtr->priority) &&
+			vtI2CSameRead(other,msgPtr->slvAddr,msgPtr->txLen,msgPtr->txBuf,msgPtr->rxLen)) {
+			return(other);
+		}
+	}
+	return(NULL);
+}
+
+// Find a result of an identical read that is still fresh
+static vtI2CCacheEntry *vtI2CCacheFind(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	vtI2CCacheEntry *entry;
+	int i;
+
+	if ((devPtr->coalesceWindow == 0) || !vtI2CCanCoalesce(msgPtr)) return(NULL);
+	for (i=0;i<vtI2CCacheLen;i++) {
+		entry = &(devPtr->cache[i]);
+		if (entry->valid && ((xTaskGetTickCount() - entry->when) < devPtr->coalesceWindow) &&
+			vtI2CSameRead(msgPtr,entry->slvAddr,entry->txLen,entry->txBuf,entry->rxLen)) {
+			return(entry);
+		}
+	}
+	return(NULL);
+}
+
+// Keep the result of a successful read (replacing an older result of the same read, or else the oldest one)
+static void vtI2CCacheStore(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	vtI2CCacheEntry *entry = &(devPtr->cache[0]);
+	int i;
+
+	if ((devPtr->coalesceWindow == 0) || !vtI2CCanCoalesce(msgPtr) || (msgPtr->status != vtI2CStatusOk)) return;
+	for (i=0;i<vtI2CCacheLen;i++) {
+		if (!devPtr->cache[i].valid || vtI2CSameRead(msgPtr,devPtr->cache[i].slvAddr,devPtr->cache[i].txLen,devPtr->cache[i].txBuf,devPtr->cache[i].rxLen)) {
+			entry = &(devPtr->cache[i]);
+			break;
+		}
+		if ((int32_t) (devPtr->cache[i].when - entry->when) < 0) {
+			entry = &(devPtr->cache[i]);
+		}
+	}
+	entry->slvAddr = msgPtr->slvAddr;
+	entry->txLen = msgPtr->txLen;
+	entry->rxLen = msgPtr->rxLen;
+	for (i=0;i<msgPtr->txLen;i++) {
+		entry->txBuf[i] = msgPtr->txBuf[i];
+	}
+	for (i=0;i<msgPtr->rxLen;i++) {
+		entry->rxBuf[i] = msgPtr->rxBuf[i];
+	}
+	entry->when = xTaskGetTickCount();
+	entry->valid = 1;
+}
+
+// Move the messages waiting on one of the input queues into the ring (as many as fit)
+//   Reads that can be answered from cache are completed right here and reads that are identical to one that is already
+//   in the batch are hung off of it, so neither of them takes up room in the ring
+//   The interrupt handler is idle here, so it will not look at the ring until the batch is started
+// Return:
+//   A program (see vtI2CEnQProgram()) taken off the queue, which must be run by itself -- it is only taken when the
+//   batch is still empty, and nothing more is gathered after it; NULL if there is none
+static vtI2CMsg *vtI2CGather(vtI2CStruct *devPtr,xQueueHandle q,uint8_t batchStart)
+{
+	vtI2CMsg *msgPtr, *leader;
+	vtI2CCacheEntry *entry;
+	int i;
+
+	// Look before taking, so that a message that does not fit stays at the head of the queue
+	while (xQueuePeek(q,(void *) &msgPtr,0) == pdTRUE) {
+		if (msgPtr->prog != NULL) {
+			if (devPtr->ringHead != batchStart) {
+				break;
+			}
+			if (xQueueReceive(q,(void *) &msgPtr,0) != pdTRUE) {
+				VT_HANDLE_FATAL_ERROR(0);
+			}
+			vtITMu8(vtITMPortI2CMsg,msgPtr->msgType);
+			return(msgPtr);
+		}
+		entry = vtI2CCacheFind(devPtr,msgPtr);
+		leader = (entry == NULL) ? vtI2CFindLeader(devPtr,batchStart,msgPtr) : NULL;
+		if ((entry == NULL) && (leader == NULL) && ((uint8_t) (devPtr->ringHead - batchStart) >= vtI2CChainLen)) {
+			break;
+		}
+		if (xQueueReceive(q,(void *) &msgPtr,0) != pdTRUE) {
+			VT_HANDLE_FATAL_ERROR(0);
+		}
+		//Log that we are processing a message
+		vtITMu8(vtITMPortI2CMsg,msgPtr->msgType);
+		msgPtr->dupNext = NULL;
+		if (entry != NULL) {
+			for (i=0;i<entry->rxLen;i++) {
+				msgPtr->rxBuf[i] = entry->rxBuf[i];
+			}
+			msgPtr->status = vtI2CStatusOk;
+			devPtr->cacheHits++;
+			vtI2CComplete(devPtr,msgPtr);
+		} else if (leader != NULL) {
+			msgPtr->dupNext = leader->dupNext;
+			leader->dupNext = msgPtr;
+			devPtr->coalesced++;
+		} else {
+			devPtr->ring[devPtr->ringHead & vtI2CRingMask] = msgPtr;
+			devPtr->ringHead++;
+		}
+	}
+	return(NULL);
+}
+
+// Which histogram bucket a time goes in (see vtI2CHistLen)
+static uint8_t vtI2CHistBucket(uint32_t t)
+{
+	uint8_t bucket = 0;
+
+	while ((t != 0) && (bucket < vtI2CHistLen-1)) {
+		bucket++;
+		t >>= 1;
+	}
+	return(bucket);
+}
+
+// Add a transaction that went on the bus to the statistics of its slave address
+static void vtI2CCountSlave(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	vtI2CSlaveStats *stats = NULL;
+	int i;
+
+	taskENTER_CRITICAL();
+	for (i=0;i<devPtr->slaveCount;i++) {
+		if (devPtr->slaveStats[i].slvAddr == msgPtr->slvAddr) {
+			stats = &(devPtr->slaveStats[i]);
+			break;
+		}
+	}
+	if (stats == NULL) {
+		// A new address gets its own entry, except for the last entry, which is kept for all of the rest
+		i = devPtr->slaveCount;
+		if (i == vtI2CMaxSlaves) {
+			i--;
+		} else if (i == vtI2CMaxSlaves-1) {
+			memset(&(devPtr->slaveStats[i]),0,sizeof(vtI2CSlaveStats));
+			devPtr->slaveStats[i].slvAddr = vtI2CStatsOther;
+			devPtr->slaveCount++;
+		} else {
+			memset(&(devPtr->slaveStats[i]),0,sizeof(vtI2CSlaveStats));
+			devPtr->slaveStats[i].slvAddr = msgPtr->slvAddr;
+			devPtr->slaveCount++;
+		}
+		stats = &(devPtr->slaveStats[i]);
+	}
+	stats->count++;
+	stats->txBytes += msgPtr->txLen;
+	stats->rxBytes += msgPtr->rxLen;
+	if (msgPtr->status == vtI2CStatusError) stats->nacks++;
+	if (msgPtr->status == vtI2CStatusTimeout) stats->timeouts++;
+	stats->retries += msgPtr->retries;
+	stats->waitHist[vtI2CHistBucket(vtI2CCyclesToUs(msgPtr->tStart - msgPtr->cEnq))]++;
+	stats->busHist[vtI2CHistBucket(vtI2CCyclesToUs(msgPtr->tDone - msgPtr->tStart))]++;
+	taskEXIT_CRITICAL();
+}
+
+// Hand back a completed transaction, along with the identical reads that share its result
+static void vtI2CFinish(vtI2CStruct *devPtr,vtI2CMsg *msgPtr)
+{
+	vtI2CMsg *dup, *next;
+	int i;
+
+	for (dup=msgPtr->dupNext;dup!=NULL;dup=next) {
+		next = dup->dupNext;
+		dup->status = msgPtr->status;
+		dup->txLen = msgPtr->txLen;
+		dup->rxLen = msgPtr->rxLen;
+		for (i=0;i<msgPtr->rxLen;i++) {
+			dup->rxBuf[i] = msgPtr->rxBuf[i];
+		}
+		vtI2CComplete(devPtr,dup);
+	}
+	vtI2CCountSlave(devPtr,msgPtr);
+	vtI2CCacheStore(devPtr,msgPtr);
+	// this may release the descriptor, so it comes last
+	vtI2CComplete(devPtr,msgPtr);
+}
+
+// I2C programs (see vtI2CEnQProgram())
+//
+// Put the transfers collected in the step descriptor on the bus, by themselves
+static void vtI2CProgRun(vtI2CStruct *devPtr,uint8_t slvAddr)
+{
+	vtI2CMsg *step = &(devPtr->progStep);
+
+	step->slvAddr = slvAddr;
+	step->tEnq = portGET_RUN_TIME_COUNTER_VALUE();
+	step->cEnq = vtCycleCount();
+	devPtr->ring[devPtr->ringHead & vtI2CRingMask] = step;
+	devPtr->ringHead++;
+	vtI2CStartMsg(devPtr,step);
+	vtI2CBatchWait(devPtr);
+	vtI2CCountSlave(devPtr,step);
+}
+
+// Empty the step descriptor
+static void vtI2CProgClear(vtI2CMsg *step)
+{
+	step->segCount = 0;
+	step->txLen = 0;
+	step->rxLen = 0;
+}
+
+// Run whatever has been collected in the step descriptor and add what was read to the program's descriptor
+// Return:
+//   pdFALSE (with the status of the program set) if the transfer failed
+static portBASE_TYPE vtI2CProgFlush(vtI2CStruct *devPtr,vtI2CMsg *progPtr)
+{
+	vtI2CMsg *step = &(devPtr->progStep);
+
+	if (step->segCount > 0) {
+		vtI2CProgRun(devPtr,progPtr->slvAddr);
+		if (step->status == vtI2CStatusOk) {
+			memcpy(&(progPtr->rxBuf[progPtr->rxLen]),step->rxBuf,step->rxLen);
+			progPtr->rxLen += step->rxLen;
+		} else {
+			progPtr->status = step->status;
+		}
+		vtI2CProgClear(step);
+	}
+	return((progPtr->status == vtI2CStatusOk) ? pdTRUE : pdFALSE);
+}
+
+// Add one transfer (a write, a read, or a write and then a read) to the step descriptor, running what is already
+//   there first if this does not fit
+static portBASE_TYPE vtI2CProgTransfer(vtI2CStruct *devPtr,vtI2CMsg *progPtr,uint8_t txLen,const uint8_t *txData,uint8_t rxLen)
+{
+	vtI2CMsg *step = &(devPtr->progStep);
+
+	if (progPtr->rxLen + step->rxLen + rxLen > vtI2CMLen) {
+		// the program reads more than a descriptor holds without a vtI2COpDeliver in between
+		progPtr->status = vtI2CStatusError;
+		return(pdFALSE);
+	}
+	// (room for a stop, a write and a read)
+	if ((step->segCount + 3 > vtI2CMaxSegs) || (step->txLen + txLen > vtI2CTxMLen)) {
+		if (vtI2CProgFlush(devPtr,progPtr) != pdTRUE) return(pdFALSE);
+	}
+	if (step->segCount > 0) {
+		vtI2CMsgAddSeg(step,vtI2CSegStop,0,NULL);
+	}
+	if ((txData != NULL) || (rxLen == 0)) {
+		vtI2CMsgAddSeg(step,vtI2CSegWrite,txLen,txData);
+	}
+	if (rxLen > 0) {
+		vtI2CMsgAddSeg(step,vtI2CSegRead,rxLen,NULL);
+	}
+	return(pdTRUE);
+}
+
+// Hand out what a program has read so far in a descriptor of its own
+static void vtI2CProgDeliver(vtI2CStruct *devPtr,vtI2CMsg *progPtr)
+{
+	vtI2CMsg *msgPtr;
+
+	// Never wait here: the descriptors that are in use may be waiting on this task
+	if ((msgPtr = vtI2CMsgGet(devPtr,0)) == NULL) {
+		devPtr->progDropped++;
+	} else {
+		msgPtr->msgType = progPtr->msgType;
+		msgPtr->slvAddr = progPtr->slvAddr;
+		msgPtr->rxLen = progPtr->rxLen;
+		memcpy(msgPtr->rxBuf,progPtr->rxBuf,progPtr->rxLen);
+		msgPtr->status = vtI2CStatusOk;
+		msgPtr->replyQ = progPtr->replyQ;
+		msgPtr->callback = progPtr->callback;
+		msgPtr->cbArg = progPtr->cbArg;
+		msgPtr->priority = progPtr->priority;
+		msgPtr->tEnq = progPtr->tEnq;
+		msgPtr->cEnq = progPtr->cEnq;
+		vtI2CComplete(devPtr,msgPtr);
+	}
+	progPtr->rxLen = 0;
+}
+
+// Run a program from start to end and hand back its descriptor (the ring is empty and the interrupt handler is idle)
+static void vtI2CRunProgram(vtI2CStruct *devPtr,vtI2CMsg *progPtr)
+{
+	vtI2CMsg *step = &(devPtr->progStep);
+	const uint8_t *pc = progPtr->prog;
+	const uint8_t *loopStart = NULL;
+	uint8_t loopLeft = 0;
+	uint8_t txLen, rxLen, i;
+	const uint8_t *txData;
+
+	progPtr->rxLen = 0;
+	progPtr->txLen = 0;
+	progPtr->status = vtI2CStatusOk;
+	vtI2CProgClear(step);
+	while (*pc != vtI2COpEnd) {
+		switch (*pc) {
+			case vtI2COpWrite:
+			case vtI2COpRead: {
+				txLen = 0;
+				txData = NULL;
+				rxLen = 0;
+				if (*pc == vtI2COpWrite) {
+					txLen = pc[1];
+					txData = &(pc[2]);
+					pc += 2 + txLen;
+					// a read right after a write goes with it
+					if (*pc == vtI2COpRead) {
+						rxLen = pc[1];
+						pc += 2;
+					}
+				} else {
+					rxLen = pc[1];
+					pc += 2;
+				}
+				if (vtI2CProgTransfer(devPtr,progPtr,txLen,txData,rxLen) != pdTRUE) goto done;
+				break;
+			}
+			case vtI2COpDelay: {
+				if (vtI2CProgFlush(devPtr,progPtr) != pdTRUE) goto done;
+				vTaskDelay(pc[1]);
+				pc += 2;
+				break;
+			}
+			case vtI2COpPoll: {
+				if (vtI2CProgFlush(devPtr,progPtr) != pdTRUE) goto done;
+				for (i=0;i<pc[4];i++) {
+					if (i > 0) vTaskDelay(pc[5]);
+					vtI2CMsgAddSeg(step,vtI2CSegWrite,1,&(pc[1]));
+					vtI2CMsgAddSeg(step,vtI2CSegRead,1,NULL);
+					vtI2CProgRun(devPtr,progPtr->slvAddr);
+					vtI2CProgClear(step);
+					if (step->status != vtI2CStatusOk) {
+						progPtr->status = step->status;
+						goto done;
+					}
+					if ((step->rxBuf[0] & pc[2]) == pc[3]) break;
+				}
+				if (i == pc[4]) {
+					progPtr->status = vtI2CStatusTimeout;
+					goto done;
+				}
+				pc += 6;
+				break;
+			}
+			case vtI2COpLoop: {
+				loopLeft = pc[1];
+				pc += 2;
+				loopStart = pc;
+				break;
+			}
+			case vtI2COpNext: {
+				if (--loopLeft > 0) {
+					pc = loopStart;
+				} else {
+					pc++;
+				}
+				break;
+			}
+			case vtI2COpDeliver: {
+				if (vtI2CProgFlush(devPtr,progPtr) != pdTRUE) goto done;
+				vtI2CProgDeliver(devPtr,progPtr);
+				pc++;
+				break;
+			}
+			default: {
+				// vtI2CMsgSubmit() checked the program, so this cannot happen
+				VT_HANDLE_FATAL_ERROR(*pc);
+				break;
+			}
+		}
+	}
+	vtI2CProgFlush(devPtr,progPtr);
+done:
+	vtI2CProgClear(step);
+	vtI2CComplete(devPtr,progPtr);
+}
 
 // This is the actual task that is run
 static portTASK_FUNCTION( vI2CMonitorTask, pvParameters )
 {
 	// Get the i2c structure for this task/device
 	vtI2CStruct *devPtr = (vtI2CStruct *) pvParameters;
-	vtI2CMsg msgBuffer;
-	uint8_t tmpRxBuf[vtI2CMLen];
-	I2C_M_SETUP_Type transferMCfg;
-	int i;
+	uint8_t batchStart, idx;
+	portTickType wait, normalWait;
+	vtI2CMsg *progPtr;
 
 	for (;;) {
-		// wait for a message from another task telling us to send/recv over i2c
-		if (xQueueReceive(devPtr->inQ,(void *) &msgBuffer,portMAX_DELAY) != pdTRUE) {
-			VT_HANDLE_FATAL_ERROR(0);
+		// Put together a batch: high priority work first, and if there is any, nothing else
+		batchStart = devPtr->ringHead;
+		wait = portMAX_DELAY;
+		if ((progPtr = vtI2CGather(devPtr,devPtr->inQHi,batchStart)) == NULL) {
+			wait = vtI2CPollRun(devPtr,batchStart,vtI2CPrioHigh);
+			if (devPtr->ringHead == batchStart) {
+				normalWait = vtI2CPollRun(devPtr,batchStart,vtI2CPrioNormal);
+				if (normalWait < wait) wait = normalWait;
+				progPtr = vtI2CGather(devPtr,devPtr->inQ,batchStart);
+			}
 		}
-		//Log that we are processing a message
-		vtITMu8(vtITMPortI2CMsg,msgBuffer.msgType);
-
-		// process the messsage and perform the I2C transaction
-		transferMCfg.sl_addr7bit = msgBuffer.slvAddr;
-		transferMCfg.tx_data = msgBuffer.buf;
-		transferMCfg.tx_length = msgBuffer.txLen;
-		transferMCfg.rx_data = tmpRxBuf;
-		transferMCfg.rx_length = msgBuffer.rxLen;
-		transferMCfg.retransmissions_max = 3;
-		transferMCfg.retransmissions_count = 0;	 // this *should* be initialized in the LPC code, but is not for interrupt mode
-		msgBuffer.status = I2C_MasterTransferData(devPtr->devAddr, &transferMCfg, I2C_TRANSFER_INTERRUPT);
-		// Block until the I2C operation is complete -- we *cannot* overlap operations on the I2C bus...
-		if (xSemaphoreTake(devPtr->binSemaphore,portMAX_DELAY) != pdTRUE) {
-			// something went wrong 
-			VT_HANDLE_FATAL_ERROR(0);
+		if (progPtr != NULL) {
+			// a program has the bus to itself until it ends
+			vtI2CRunProgram(devPtr,progPtr);
+			continue;
 		}
-		msgBuffer.txLen = transferMCfg.tx_count;
-		msgBuffer.rxLen = transferMCfg.rx_count;
-		// Now send out a message with the data that was read
-		// First, copy over the buffer that was received (if any)
-		for (i=0;i<msgBuffer.rxLen;i++) {
-			msgBuffer.buf[i] = tmpRxBuf[i];
+		if (devPtr->ringHead == batchStart) {
+			// wait for a message from another task telling us to send/recv over i2c (or for a poll job to fall due)
+			xSemaphoreTake(devPtr->doorbell,(wait == 0) ? 1 : wait);
+			continue;
+		}
+
+		// Start the first transaction; the interrupt handler runs the rest of the batch by itself
+		vtI2CStartMsg(devPtr,devPtr->ring[batchStart & vtI2CRingMask]);
+		// Block until the whole batch is complete (or has timed out) -- we *cannot* overlap operations on the I2C bus...
+		vtI2CBatchWait(devPtr);
+
+		// now hand the descriptors back, in the order in which they were run
+		for (idx=batchStart;idx!=devPtr->ringHead;idx++) {
+			vtI2CFinish(devPtr,devPtr->ring[idx & vtI2CRingMask]);
 		}
-		// now put a message in the message queue
-		if (xQueueSend(devPtr->outQ,(void*)(&msgBuffer),portMAX_DELAY) != pdTRUE) {
-			// something went wrong 
-			VT_HANDLE_FATAL_ERROR(0);
-		} 
 	}
-}
\ No newline at end of file
+}
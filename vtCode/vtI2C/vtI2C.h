@@ -10,9 +10,157 @@
 // return codes for vtI2CInit()
 #define vtI2CErrInit -1
 #define vtI2CInitSuccess 0
+// return codes for vtI2CReserveDevice()
+#define vtI2CErrPlace -1
+#define vtI2CPlaceSuccess 0
 
-// The maximum length of a message to be sent/received over I2C 
+// values of status in a completed descriptor
+#define vtI2CStatusError ERROR			// The slave did not answer (or the bus was lost) -- rxLen/txLen say how far it got
+#define vtI2CStatusOk SUCCESS			// Everything was sent and received
+#define vtI2CStatusTimeout 2			// The transaction did not finish in time and the bus was reset (see vtI2CGetErrorCounts())
+
+// The maximum length of a message to be received over I2C 
 #define vtI2CMLen 64
+// The maximum length of a message to be sent over I2C (commands are short, so this is kept small to save RAM)
+#define vtI2CTxMLen 16
+// Number of transaction descriptors in the pool of each I2C peripheral -- this is also the most transactions
+//   that can be outstanding (queued, in progress, or waiting to be picked up) on one I2C bus at a time
+#define vtI2CPoolLen 6
+// Most transactions the I2C interrupt handler will run back-to-back before it wakes up the I2C task
+//   Must be a power of 2 and no larger than vtI2CPoolLen; set it to 1 to run one transaction per wakeup
+#define vtI2CChainLen 4
+
+// Priority classes of transactions (see vtI2CMsg.priority)
+//   The I2C task always takes every waiting high priority transaction before any normal one, and a batch that has a high
+//   priority transaction in it holds nothing else, so a high priority transaction waits for at most one batch that is
+//   already on the bus (no matter how many normal ones are queued up)
+#define vtI2CPrioNormal 0
+#define vtI2CPrioHigh 1
+#define vtI2CNumPrio 2
+
+// Number of recent read results kept by each I2C peripheral for answering identical reads (see vtI2CSetCoalesce())
+#define vtI2CCacheLen 2
+
+// Number of slave addresses that each I2C peripheral keeps statistics for (see vtI2CGetSlaveStats()) -- any others
+//   are lumped together under address vtI2CStatsOther
+#define vtI2CMaxSlaves 6
+#define vtI2CStatsOther 0xFF
+// Number of buckets in the latency histograms: bucket 0 counts latencies under 1us, bucket n those from 2^(n-1) up to
+//   2^n - 1 microseconds, and the last bucket everything longer
+#define vtI2CHistLen 16
+
+// Most segments in one compound transaction (see vtI2CMsgAddSeg())
+#define vtI2CMaxSegs 8
+// Segment types of a compound transaction
+#define vtI2CSegWrite 0			// Send len bytes (taken in order from txBuf)
+#define vtI2CSegRead 1			// Receive len bytes (stored in order in rxBuf)
+#define vtI2CSegRestart 2		// Repeated start (there is always one where the direction changes, so this is only needed
+								//   between two writes or two reads that must not run together)
+#define vtI2CSegStop 3			// Stop condition; whatever follows starts over with a new start condition
+
+// One segment of a compound transaction
+typedef struct __vtI2CSeg {
+	uint8_t op;		// One of the segment types above
+	uint8_t len;	// Number of bytes to send/receive (on the way back, the number that *were* sent/received)
+} vtI2CSeg;
+
+// Function called by the I2C task when a transaction completes (see vtI2CEnQCallback())
+struct __vtI2CMsg;
+typedef void (*vtI2CCallback)(struct __vtI2CMsg *msg,void *arg);
+
+// Transaction descriptor
+//   Descriptors live in a fixed pool inside the vtI2CStruct and only pointers to them are passed through the
+//   queues, so the data is never copied between tasks.  Borrow one with vtI2CMsgGet(), fill it in place,
+//   hand it over with vtI2CMsgSubmit(), pick up the result with vtI2CMsgWait() and give it back with vtI2CMsgRelease()
+typedef struct __vtI2CMsg {
+	uint8_t msgType; // A field you will likely use in your communications between processors (and for debugging)
+	uint8_t slvAddr; // Address of the device to whom the message is being sent (or was sent)
+	uint8_t	rxLen;	 // Length of the message you *expect* to receive (or, on the way back, the length that *was* received)
+	uint8_t txLen;   // Length of the message you want to sent (or, on the way back, the length that *was* sent)
+	uint8_t status;  // status of the completed operation (vtI2CStatusOk, vtI2CStatusError or vtI2CStatusTimeout)
+	uint8_t txBuf[vtI2CTxMLen]; // Message to be sent (if any)
+	uint8_t rxBuf[vtI2CMLen];   // Message received (if any) -- the I2C interrupt handler writes straight into this buffer
+	uint8_t segCount;			// Number of segments of a compound transaction -- 0 for a plain write-then-read of txLen/rxLen
+	vtI2CSeg seg[vtI2CMaxSegs];	// The segments of a compound transaction (see vtI2CMsgAddSeg())
+	// Where the completed descriptor goes -- if both are NULL, it goes to the outQ of the I2C peripheral
+	xQueueHandle replyQ;		// If not NULL, the completed descriptor (a vtI2CMsg *) is sent to this queue
+	vtI2CCallback callback;		// If not NULL, called from the I2C task with the completed descriptor, which is released afterwards
+	void *cbArg;				// Passed to the callback as is
+	portTickType timeout;		// Longest time the transaction may be on the bus -- 0 to work it out from the lengths and bus speed
+	uint8_t priority;			// vtI2CPrioNormal or vtI2CPrioHigh
+	uint8_t noCoalesce;			// Set to 1 if this read must really go on the bus (e.g., it empties a FIFO in the slave)
+	const uint8_t *prog;		// If not NULL, an I2C program to run instead of txBuf/rxLen or segments (see vtI2CEnQProgram())
+	uint32_t tEnq;				// Run time counter value when the transaction was handed to the I2C task (the time of the sample)
+	uint32_t cEnq;				// Cycle counter value at the same time (see vtCycleCount()), for the latency counts
+	uint32_t tStart;			// Cycle counter value when the transaction went on the bus
+	uint32_t tDone;				// Cycle counter value when the transaction came off the bus
+	uint8_t retries;			// Number of times the transaction had to be started over (NACK or lost arbitration)
+	// Used by the I2C interrupt handler while this transaction is on the bus -- do not touch
+	//   The transaction is broken down into phases, each one being an address byte and then data in one direction;
+	//   the first phase comes after a start and the others after a repeated start (or a stop and a start)
+	uint8_t phaseCount;
+	uint8_t phaseLen[vtI2CMaxSegs];
+	uint8_t phaseFlags[vtI2CMaxSegs];
+	uint8_t phase, left;		// Phase on the bus and the number of bytes left in it
+	uint8_t grpPhase;			// Phase (and positions) to go back to when the slave does not answer or the bus is lost
+	uint8_t grpTx, grpRx;
+	uint8_t txPos, rxPos;		// Bytes sent/received so far
+	struct __vtI2CMsg *dupNext;	// Identical reads that get the result of this one (used by the I2C task)
+} vtI2CMsg;
+
+// Most periodic poll jobs per I2C peripheral (see vtI2CPollStart())
+#define vtI2CMaxPollJobs 4
+
+// A periodic poll job -- the I2C task itself runs the transaction every period and delivers only the result
+//   The storage belongs to the caller and must stay around (and unchanged) until vtI2CPollStop() is called
+typedef struct __vtI2CPollJob {
+	uint8_t msgType;			// Copied into each result descriptor
+	uint8_t slvAddr;			// The address of the i2c slave device
+	uint8_t txLen;				// Length of the command to send
+	uint8_t txBuf[vtI2CTxMLen];	// Command to send
+	uint8_t rxLen;				// Number of bytes to read back
+	portTickType period;		// Ticks between two transactions -- 0 to run them back-to-back, as fast as the bus allows
+								//   (such a job takes up to half of every batch, so other transactions still get through)
+	uint8_t priority;			// vtI2CPrioNormal or vtI2CPrioHigh
+	xQueueHandle replyQ;		// Where the results go (see vtI2CMsg) -- both NULL means the outQ of the I2C peripheral
+	vtI2CCallback callback;
+	void *cbArg;
+	// Used by the I2C task -- do not touch
+	portTickType nextDue;		// Tick at which the job is to be run next
+	uint32_t missed;			// Number of periods skipped because no descriptor was free or the bus was too busy
+} vtI2CPollJob;
+
+// Latency counts (see vtI2CGetLatency()) -- in microseconds, taken from the cycle counter (the run time stats counter
+//   only has a resolution of 100us, which is longer than most transactions)
+typedef struct __vtI2CLatency {
+	uint32_t count;		// Number of transactions completed
+	uint32_t total;		// Sum of their latencies
+	uint32_t max;		// Longest latency
+} vtI2CLatency;
+
+// A recent read result (see vtI2CSetCoalesce())
+typedef struct __vtI2CCacheEntry {
+	uint8_t valid;
+	uint8_t slvAddr;
+	uint8_t txLen;
+	uint8_t rxLen;
+	uint8_t txBuf[vtI2CTxMLen];
+	uint8_t rxBuf[vtI2CMLen];
+	portTickType when;		// Tick at which the read completed
+} vtI2CCacheEntry;
+
+// Statistics for one slave address (see vtI2CGetSlaveStats()) -- times are in microseconds
+typedef struct __vtI2CSlaveStats {
+	uint8_t slvAddr;					// The address (vtI2CStatsOther for the ones that did not fit in the table)
+	uint32_t count;						// Number of transactions on the bus
+	uint32_t txBytes;					// Bytes sent
+	uint32_t rxBytes;					// Bytes received
+	uint32_t nacks;						// Transactions that failed (status vtI2CStatusError)
+	uint32_t timeouts;					// Transactions that timed out
+	uint32_t retries;					// Total of the times that transactions were started over by the interrupt handler (NACK or lost arbitration)
+	uint32_t waitHist[vtI2CHistLen];	// Time from vtI2CMsgSubmit() until the transaction went on the bus
+	uint32_t busHist[vtI2CHistLen];		// Time that the transaction was on the bus
+} vtI2CSlaveStats;
 
 // Structure that is used to define the operate of an I2C peripheral using the vtI2C routines
 //   It should be initialized by vtI2CInit() and then not changed by anything... ever
@@ -21,9 +169,34 @@ typedef struct __vtI2CStruct {
 	uint8_t devNum;	  						// Number of the I2C peripheral (0,1,2 on the 1768)
 	LPC_I2C_TypeDef *devAddr;	 			// Memory address of the I2C peripheral
 	unsigned portBASE_TYPE taskPriority;   	// Priority of the I2C task
+	uint32_t speed;							// Clock speed of the i2c bus
+	uint32_t timeouts;						// Number of transactions that did not finish in time
+	uint32_t recoveries;					// Number of times a slave was found holding SDA low and had to be clocked free
 	xSemaphoreHandle binSemaphore;		   	// Semaphore used between I2C task and I2C interrupt handler
-	xQueueHandle inQ;					   	// Queue used to send messages from other tasks to the I2C task
-	xQueueHandle outQ;						// Queue used by the I2C task to send out results
+	xQueueHandle inQ;					   	// Queue of (vtI2CMsg *) used to send messages from other tasks to the I2C task
+	xQueueHandle inQHi;						// The same, for high priority messages
+	xSemaphoreHandle doorbell;				// Given whenever something is put on inQ/inQHi (or a poll job is started)
+	xQueueHandle outQ;						// Queue of (vtI2CMsg *) used by the I2C task to send out results
+	xQueueHandle freeQ;						// Queue of (vtI2CMsg *) holding the descriptors that are not in use
+	vtI2CMsg pool[vtI2CPoolLen];			// Storage for the transaction descriptors
+	// Ring of transactions handed from the I2C task to the interrupt handler
+	//   Only the I2C task writes ringHead and only the interrupt handler writes ringTail, so no lock is needed;
+	//   the indices run freely and are masked with (vtI2CChainLen-1) to get a slot
+	vtI2CMsg *ring[vtI2CChainLen];
+	volatile uint8_t ringHead;				// Next slot to be filled by the I2C task
+	volatile uint8_t ringTail;				// Slot of the transaction that is on the bus
+	uint32_t placedLoad;					// Total load of the devices placed on this bus (see vtI2CPlaceDevice())
+	uint32_t placedAddr[4];					// Bitmap of the addresses of the devices placed on this bus
+	vtI2CPollJob * volatile poll[vtI2CMaxPollJobs];	// The periodic poll jobs (NULL for an empty slot)
+	vtI2CLatency latency[vtI2CNumPrio];		// Time from vtI2CMsgSubmit() to completion, for each priority class
+	portTickType coalesceWindow;			// How long a read result may be handed out again (0 for not at all)
+	vtI2CCacheEntry cache[vtI2CCacheLen];	// Recent read results
+	uint32_t coalesced;						// Number of reads that shared a bus transfer with an identical one
+	uint32_t cacheHits;						// Number of reads answered from cache without going on the bus
+	uint8_t slaveCount;						// Number of entries of slaveStats in use
+	vtI2CSlaveStats slaveStats[vtI2CMaxSlaves];	// Statistics of each slave address seen on this bus
+	vtI2CMsg progStep;						// The transfers of an I2C program that go on the bus together (used by the I2C task)
+	uint32_t progDropped;					// Number of vtI2COpDeliver results lost because no descriptor was free
 } vtI2CStruct;
 
 /* ********************************************************************* */
@@ -31,15 +204,51 @@ typedef struct __vtI2CStruct {
 
 // Args:
 //   dev: pointer to the vtI2CStruct data structure
-//   i2cDevNum: The number of the i2c device -- 0, 1, or 2
+//   i2cDevNum: The number of the i2c device -- 0 (P0.27/P0.28), 1 (P0.0/P0.1), or 2 (P0.10/P0.11)
 //   taskPriority: At what priority should this task be run?
 //   i2cSpeed: Clock speed of the i2c bus
 // Return:
 //   if successful, returns vtI2CInitSuccess
 //   if not, should return vtI2CErrInit
 // Must be called for each I2C device initialized (0, 1, or 2) and used
+//   Each one gets its own task and interrupt handler, so transactions on different I2C devices run at the same time
 int vtI2CInit(vtI2CStruct *devPtr,uint8_t i2cDevNum,unsigned portBASE_TYPE taskPriority,uint32_t i2cSpeed);
 
+// Hand an I2C peripheral over to some other interrupt handler (e.g., the slave code in vtI2CSlave.c) instead of
+//   the I2C task -- the pins are connected and the peripheral is switched on and its interrupt is enabled, but nothing else
+// Args:
+//   i2cDevNum: The number of the i2c device -- 0, 1, or 2 (see vtI2CInit() for the pins)
+//   isr: called from the interrupt handler of the I2C peripheral
+//   arg: passed to isr as is
+// Return:
+//   if successful, returns vtI2CInitSuccess
+//   if not (no such device, or it is already in use), returns vtI2CErrInit
+typedef void (*vtI2CIsrHook)(void *arg);
+int vtI2CAttachIsr(uint8_t i2cDevNum,vtI2CIsrHook isr,void *arg);
+
+// Spreading polled devices across the I2C peripherals
+//   A device on a bus that is already busy has to queue up behind the other devices on that bus, so devices that can be
+//   reached from (or wired to) more than one bus should go on the one with the least load.  The load is in whatever unit
+//   you like, as long as every call uses the same one (bytes per second is a good choice).
+//   These are meant to be called at start-up, from one task (or before the scheduler is started).
+//
+// Record a device that is wired to a particular I2C peripheral, so that its load is taken into account
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   slvAddr: The address of the i2c slave device
+//   load: the load that the device puts on the bus
+// Return:
+//   vtI2CPlaceSuccess, or vtI2CErrPlace if there already is a device with that address on the bus
+int vtI2CReserveDevice(vtI2CStruct *dev,uint8_t slvAddr,uint32_t load);
+//
+// Pick the initialized I2C peripheral with the least load for a device (and record the device on it)
+// Args
+//   slvAddr: The address of the i2c slave device -- a bus that already has a device at this address is never picked
+//   load: the load that the device puts on the bus
+// Return:
+//   pointer to the vtI2CStruct data structure of the chosen I2C peripheral, or NULL if there is none
+vtI2CStruct *vtI2CPlaceDevice(uint8_t slvAddr,uint32_t load);
+
 // A simple routine to use for filling out and sending a message to the I2C thread
 //   You may want to make your own versions of these as they are not suited to all purposes
 // Args
@@ -53,6 +262,20 @@ int vtI2CInit(vtI2CStruct *devPtr,uint8_t i2cDevNum,unsigned portBASE_TYPE taskP
 //   Result of the call to xQueueSend()
 portBASE_TYPE vtI2CEnQ(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen);
 
+// The same as vtI2CEnQ(), but the result is sent straight to the task that asked for it instead of to the shared outQ
+// Args (in addition to those of vtI2CEnQ())
+//   replyQ: queue of (vtI2CMsg *) to which the completed descriptor is sent -- the receiver must call vtI2CMsgRelease() on it
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE vtI2CEnQReply(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen,xQueueHandle replyQ);
+// Args (in addition to those of vtI2CEnQ())
+//   callback: called from the I2C task with the completed descriptor -- it must not block for long (the bus waits on it)
+//             and must not keep the descriptor, which is released when it returns
+//   cbArg: passed to the callback as is
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE vtI2CEnQCallback(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t txLen,const uint8_t *txBuf,uint8_t rxLen,vtI2CCallback callback,void *cbArg);
+
 // A simple routine to use for retrieving a message from the I2C thread
 // Args
 //   dev: pointer to the vtI2CStruct data structure
@@ -64,4 +287,171 @@ portBASE_TYPE vtI2CEnQ(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,uint8_t
 // Return:
 //   Result of the call to xQueueReceive()
 portBASE_TYPE vtI2CDeQ(vtI2CStruct *dev,uint8_t maxRxLen,uint8_t *rxBuf,uint8_t *rxLen,uint8_t *msgType,uint8_t *status);
+
+// The zero-copy versions of the calls above
+//   vtI2CEnQ()/vtI2CDeQ() are built on these and each do one copy; use these directly to avoid even that
+//
+// Borrow a descriptor from the pool of the I2C peripheral (replyQ and callback start out NULL, priority vtI2CPrioNormal)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   ticksToBlock: how long the routine should wait if all of the descriptors are in use
+// Return:
+//   Pointer to the descriptor, or NULL if none became free in time
+vtI2CMsg *vtI2CMsgGet(vtI2CStruct *dev,portTickType ticksToBlock);
+//
+// Hand a filled in descriptor over to the I2C task (the caller must not touch it until it comes back)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   msg: descriptor obtained from vtI2CMsgGet() with msgType, slvAddr, txLen, txBuf and rxLen (and, optionally, replyQ or
+//        callback/cbArg, timeout and priority) filled in
+//   ticksToBlock: how long the routine should wait if the queue is full
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE vtI2CMsgSubmit(vtI2CStruct *dev,vtI2CMsg *msg,portTickType ticksToBlock);
+//
+// Compound transactions
+//   Instead of filling in txLen/txBuf/rxLen, build up a list of segments on the descriptor, e.g., for reading two
+//   registers of one device:
+//     Write 1 (register pointer), Restart, Read 2, Stop, Write 1 (register pointer), Restart, Read 1
+//   The whole list is run by the I2C interrupt handler as one submission and completes once, with all of the received
+//   bytes one after the other in rxBuf and the number of bytes that were actually moved in each segment's len.
+//   If a part of the list fails, the rest of it is not run and status is ERROR.
+//   Segments can come in any order; a repeated start is put in wherever the direction changes.  A read must be at
+//   least 1 byte long.  There is an implied stop at the end.
+// Args
+//   msg: descriptor obtained from vtI2CMsgGet()
+//   op: vtI2CSegWrite, vtI2CSegRead, vtI2CSegRestart or vtI2CSegStop
+//   len: number of bytes to send/receive (ignored for vtI2CSegRestart and vtI2CSegStop)
+//   txData: for vtI2CSegWrite, the bytes to send (they are copied to the end of txBuf); may be NULL if they are already there
+// Return:
+//   pdTRUE, or pdFALSE if the segment does not fit in the descriptor
+portBASE_TYPE vtI2CMsgAddSeg(vtI2CMsg *msg,uint8_t op,uint8_t len,const uint8_t *txData);
+//
+// Wait for a completed descriptor (one that was sent without a replyQ or callback) from the I2C task; the received data is in (*msg)->rxBuf
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   msg: set to point at the completed descriptor
+//   ticksToBlock: how long the routine should wait for a result
+// Return:
+//   Result of the call to xQueueReceive()
+portBASE_TYPE vtI2CMsgWait(vtI2CStruct *dev,vtI2CMsg **msg,portTickType ticksToBlock);
+//
+// Give a descriptor back to the pool once you are done with it
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   msg: the descriptor to give back
+void vtI2CMsgRelease(vtI2CStruct *dev,vtI2CMsg *msg);
+
+// I2C programs
+//   A device that needs a sequence of steps (configure, wait, start, poll a status bit, read...) can be handed the
+//   whole sequence at once as a program: a const table of the opcodes below, which can stay in flash.  The I2C task
+//   runs the program from start to end without going back to the caller between steps, and the reads end up one after
+//   the other in rxBuf of the descriptor, which completes (to the replyQ or callback) at vtI2COpEnd.
+//   Writes and reads that are not separated by a delay, poll or deliver are put on the bus together as one compound
+//   transaction.  A program takes the bus for as long as it runs (delays included), so keep them short.
+//   If a step fails, the rest of the program is skipped and the descriptor completes with the status of that step.
+//   e.g., configure a device, give it 10 ticks, then read 8 bytes from register 0xAA four times, 5 ticks apart:
+//     vtI2COpWrite,2,0x01,0x60, vtI2COpDelay,10, vtI2COpLoop,4, vtI2COpWrite,1,0xAA, vtI2COpRead,8, vtI2COpDeliver,
+//     vtI2COpDelay,5, vtI2COpNext, vtI2COpEnd
+#define vtI2COpEnd 0			// The end of the program
+#define vtI2COpWrite 1			// n, then n bytes: start a transfer and send the bytes (n may be 0 to just address the slave)
+#define vtI2COpRead 2			// n: read n bytes (1 to vtI2CMLen) -- right after a vtI2COpWrite, this comes after a repeated start
+#define vtI2COpDelay 3			// t: wait for t ticks
+#define vtI2COpPoll 4			// reg, mask, value, tries, t: read the 1 byte register reg until (byte & mask) == value, waiting
+								//   t ticks between tries -- status is vtI2CStatusTimeout if it never matches
+#define vtI2COpLoop 5			// n: run what follows, up to vtI2COpNext, n times (loops cannot be nested)
+#define vtI2COpNext 6			// The end of the loop
+#define vtI2COpDeliver 7		// Hand out what has been read so far in a descriptor of its own (with the same msgType,
+								//   replyQ and callback) and start rxBuf over -- if no descriptor is free, it is lost (see progDropped)
+//
+// A simple routine for sending a program to the I2C task (or fill in prog in a descriptor from vtI2CMsgGet())
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   msgType: The message type value of the result(s)
+//   slvAddr: The address of the i2c slave device that the program talks to
+//   prog: the program -- it must stay around (and unchanged) until the result comes back
+//   callback, cbArg: where the result(s) go (see vtI2CEnQCallback()) -- if callback is NULL, the outQ of the I2C peripheral
+// Return:
+//   Result of the call to xQueueSend()
+portBASE_TYPE vtI2CEnQProgram(vtI2CStruct *dev,uint8_t msgType,uint8_t slvAddr,const uint8_t *prog,vtI2CCallback callback,void *cbArg);
+
+// Timeouts
+//   Each transaction has a deadline (see vtI2CMsg.timeout); one that is not done by then comes back with status
+//   vtI2CStatusTimeout, the bus is cleared (a slave that is holding SDA low is clocked until it lets go, then a stop
+//   condition is sent) and the I2C peripheral is reset before the next transaction is started
+//
+// Get the number of timeouts and of times that the bus was found stuck since vtI2CInit()
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   timeouts: set to the number of transactions that timed out
+//   recoveries: set to the number of times a slave had to be clocked to let go of SDA
+void vtI2CGetErrorCounts(vtI2CStruct *dev,uint32_t *timeouts,uint32_t *recoveries);
+
+// Get the latency counts of one priority class
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   priority: vtI2CPrioNormal or vtI2CPrioHigh
+//   latency: filled in with the counts
+void vtI2CGetLatency(vtI2CStruct *dev,uint8_t priority,vtI2CLatency *latency);
+
+// Read coalescing
+//   Reads (transactions with rxLen > 0 and no segments) that go to the same slave with the same txBuf and rxLen are
+//   identical.  Identical reads that are waiting at the same time are put on the bus only once and every one of them
+//   gets the result.  On top of that, a read that comes in within the freshness window of an identical read that
+//   completed successfully is answered right away with that result, without using the bus at all.
+//   Set noCoalesce in a descriptor to keep it out of all of this.
+//
+// Set the freshness window (it starts out as 0, i.e., only reads that are waiting at the same time are combined)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   window: ticks for which a read result may be handed out again
+void vtI2CSetCoalesce(vtI2CStruct *dev,portTickType window);
+//
+// Get the number of reads that did not need a bus transfer of their own
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   coalesced: set to the number of reads that shared a transfer with an identical read
+//   cacheHits: set to the number of reads answered within the freshness window
+void vtI2CGetCoalesceCounts(vtI2CStruct *dev,uint32_t *coalesced,uint32_t *cacheHits);
+
+// Get the statistics for one of the slave addresses that this I2C peripheral has talked to
+//   Only transactions that actually went on the bus are counted (not reads answered by coalescing)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   idx: which one (the first one is 0)
+//   stats: filled in with a copy of the statistics
+// Return:
+//   pdTRUE, or pdFALSE if idx is past the last address seen so far
+portBASE_TYPE vtI2CGetSlaveStats(vtI2CStruct *dev,uint8_t idx,vtI2CSlaveStats *stats);
+
+// Periodic polling
+//   Instead of a timer and a task that sends the same request over and over, hand the request to the I2C task once;
+//   it is then run every period without any other task being involved, and only the results come back (to the replyQ
+//   or callback of the job).  If a period comes around while no descriptor is free, that sample is skipped (see missed).
+//
+// Start a poll job (the first transaction is run right away)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   job: the poll job, with everything above "Used by the I2C task" filled in
+// Return:
+//   pdTRUE, or pdFALSE if there already are vtI2CMaxPollJobs jobs on this I2C peripheral
+portBASE_TYPE vtI2CPollStart(vtI2CStruct *dev,vtI2CPollJob *job);
+//
+// Stop a poll job (a transaction of the job that is already under way still delivers its result)
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   job: the poll job given to vtI2CPollStart()
+void vtI2CPollStop(vtI2CStruct *dev,vtI2CPollJob *job);
+//
+// Run a poll job once, right now, from an interrupt handler -- for sampling that is paced by a hardware timer instead
+//   of by the I2C task (the job must not also be started with vtI2CPollStart())
+//   The run time counter value at the time of the call is in tEnq of the result, so it can be used as the timestamp of
+//   the sample; the read is never answered by coalescing (see vtI2CSetCoalesce())
+// Args
+//   dev: pointer to the vtI2CStruct data structure
+//   job: the poll job (period is not used)
+//   pxHigherPriorityTaskWoken: as for xQueueSendFromISR()
+// Return:
+//   pdTRUE, or pdFALSE if no descriptor was free or the queue was full (this is counted in missed)
+portBASE_TYPE vtI2CPollFromISR(vtI2CStruct *dev,vtI2CPollJob *job,signed portBASE_TYPE *pxHigherPriorityTaskWoken);
 #endif
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vtI2CSlave.h"
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "projdefs.h"
+
+/* include files. */
+#include "lpc17xx_i2c.h"
+#include "vtUtilities.h"
+
+/* ************************************************ */
+// Private definitions
+// I2STAT value for an illegal start or stop condition (the NXP driver does not name it)
+#define vtI2CSlaveBusError 0x00
+static void vtI2CSlaveIsr(void *arg);
+// End of private definitions
+/* ************************************************ */
+
+/* ************************************************ */
+// Public API Functions
+//
+int vtI2CSlaveInit(vtI2CSlave *slv,uint8_t i2cDevNum,uint8_t slvAddr)
+{
+	slv->devNum = i2cDevNum;
+	memset(slv->map,0,sizeof(slv->map));
+	slv->front = 0;
+	slv->reading = vtI2CSlaveIdle;
+	slv->regPtr = 0;
+	slv->gotPtr = 0;
+	slv->reads = 0;
+	slv->busy = 0;
+	switch (i2cDevNum) {
+		case 0: slv->devAddr = LPC_I2C0; break;
+		case 1: slv->devAddr = LPC_I2C1; break;
+		case 2: slv->devAddr = LPC_I2C2; break;
+		default: return(vtI2CErrInit);
+	}
+	if (vtI2CAttachIsr(i2cDevNum,vtI2CSlaveIsr,(void *) slv) != vtI2CInitSuccess) {
+		return(vtI2CErrInit);
+	}
+	// Answer to our address (and not to the general call), then start acknowledging it
+	slv->devAddr->I2ADR0 = (slvAddr << 1) & I2C_I2ADR_BITMASK;
+	slv->devAddr->I2CONSET = I2C_I2CONSET_AA;
+	return(vtI2CInitSuccess);
+}
+
+// There must only be one task that calls these two
+uint8_t *vtI2CSlaveBeginUpdate(vtI2CSlave *slv)
+{
+	uint8_t back = 1 - slv->front;
+
+	// The interrupt handler only ever starts on the front copy, so once it is not on the back one, it stays off it
+	if (slv->reading == back) {
+		slv->busy++;
+		return(NULL);
+	}
+	memcpy(slv->map[back],slv->map[slv->front],vtI2CSlaveMapLen);
+	return(slv->map[back]);
+}
+
+void vtI2CSlavePublish(vtI2CSlave *slv)
+{
+	// a single byte store, so the interrupt handler sees either the old or the new front copy
+	slv->front = 1 - slv->front;
+}
+// End of public API Functions
+/* ************************************************ */
+
+// i2c interrupt handler for slave mode (see vtI2CAttachIsr())
+//   We always acknowledge, so the master decides how much to write/read
+static void vtI2CSlaveIsr(void *arg)
+{
+	vtI2CSlave *slv = (vtI2CSlave *) arg;
+	LPC_I2C_TypeDef *i2c = slv->devAddr;
+	uint8_t data;
+
+	switch (i2c->I2STAT & I2C_STAT_CODE_BITMASK) {
+		// Addressed for a write: the first byte is the register number, anything after it is ignored (the map is read-only)
+		case I2C_I2STAT_S_RX_SLAW_ACK:
+		case I2C_I2STAT_S_RX_ARB_LOST_M_SLA: {
+			slv->gotPtr = 0;
+			break;
+		}
+		case I2C_I2STAT_S_RX_PRE_SLA_DAT_ACK:
+		case I2C_I2STAT_S_RX_PRE_SLA_DAT_NACK: {
+			data = i2c->I2DAT;
+			if (!slv->gotPtr) {
+				slv->regPtr = data % vtI2CSlaveMapLen;
+				slv->gotPtr = 1;
+			}
+			break;
+		}
+		// Addressed for a read: stick with the front copy until the master is done
+		case I2C_I2STAT_S_TX_SLAR_ACK:
+		case I2C_I2STAT_S_TX_ARB_LOST_M_SLA: {
+			slv->reading = slv->front;
+			slv->reads++;
+			// fall through to send the first byte
+		}
+		case I2C_I2STAT_S_TX_DAT_ACK: {
+			i2c->I2DAT = slv->map[slv->reading][slv->regPtr];
+			slv->regPtr = (slv->regPtr + 1) % vtI2CSlaveMapLen;
+			break;
+		}
+		// The master has read all it wants (or there was a stop/restart)
+		case I2C_I2STAT_S_TX_DAT_NACK:
+		case I2C_I2STAT_S_TX_LAST_DAT_ACK:
+		case I2C_I2STAT_S_RX_STA_STO_SLVREC_SLVTRX: {
+			slv->reading = vtI2CSlaveIdle;
+			break;
+		}
+		case vtI2CSlaveBusError: {
+			// let go of the bus
+			slv->reading = vtI2CSlaveIdle;
+			i2c->I2CONSET = I2C_I2CONSET_STO;
+			break;
+		}
+		default: {
+			break;
+		}
+	}
+	// Keep acknowledging and let the bus go on
+	i2c->I2CONSET = I2C_I2CONSET_AA;
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
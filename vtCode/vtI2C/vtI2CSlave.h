@@ -0,0 +1,58 @@
+#ifndef __vtI2CSlaveh
+#define __vtI2CSlaveh
+/* include files. */
+#include "lpc17xx_i2c.h"
+#include "vtI2C.h"
+
+// I2C slave mode
+//   One of the I2C peripherals answers an external I2C master as a device with a map of registers, the same way
+//   that most sensors work: the master writes one byte (the register number) and then reads as many bytes as it likes,
+//   starting at that register.  Reads are served straight from the interrupt handler, no task is involved.
+//
+//   The map is double-buffered: the application fills in the back copy and then publishes it, which swaps the copies.
+//   A read by the master always comes from the copy that was the front one when the read started, so the master
+//   never sees half of an update.
+//
+// Number of bytes in the register map (reads past the end wrap around to register 0)
+#define vtI2CSlaveMapLen 32
+
+typedef struct __vtI2CSlave {
+	uint8_t devNum;							// Number of the I2C peripheral (0,1,2 on the 1768)
+	LPC_I2C_TypeDef *devAddr;				// Memory address of the I2C peripheral
+	uint8_t map[2][vtI2CSlaveMapLen];		// The two copies of the register map
+	volatile uint8_t front;					// Copy that new reads are served from
+	volatile uint8_t reading;				// Copy that the master is reading right now (vtI2CSlaveIdle if none)
+	uint8_t regPtr;							// Next register to be read -- only the interrupt handler touches this
+	uint8_t gotPtr;							// Has the register number of the current write come in?
+	uint32_t reads;							// Number of reads by the master
+	uint32_t busy;							// Number of times vtI2CSlaveBeginUpdate() had to refuse
+} vtI2CSlave;
+#define vtI2CSlaveIdle 0xFF
+
+/* ********************************************************************* */
+// The following are the public API calls that the application should use to work with the I2C slave
+
+// Args:
+//   slv: pointer to the vtI2CSlave data structure
+//   i2cDevNum: The number of the i2c device -- 0, 1, or 2 (see vtI2CInit() for the pins); it cannot also be used by vtI2CInit()
+//   slvAddr: The (7 bit) address that this device answers to
+// Return:
+//   if successful, returns vtI2CInitSuccess
+//   if not, returns vtI2CErrInit
+// Both copies of the register map start out all 0
+int vtI2CSlaveInit(vtI2CSlave *slv,uint8_t i2cDevNum,uint8_t slvAddr);
+
+// Get the back copy of the register map to fill in
+//   It starts out holding what is in the front copy, so only the registers that change need to be written
+// Args:
+//   slv: pointer to the vtI2CSlave data structure
+// Return:
+//   pointer to the vtI2CSlaveMapLen bytes of the back copy, or NULL if the master is still reading that copy
+//   (it was the front copy when the read started) -- try again later (or skip this update)
+uint8_t *vtI2CSlaveBeginUpdate(vtI2CSlave *slv);
+
+// Make the back copy (obtained with vtI2CSlaveBeginUpdate()) the front one -- reads that start after this see it
+// Args:
+//   slv: pointer to the vtI2CSlave data structure
+void vtI2CSlavePublish(vtI2CSlave *slv);
+#endif
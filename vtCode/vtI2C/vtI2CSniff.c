@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "vtI2CSniff.h"
+/* Scheduler include files. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "projdefs.h"
+#include "semphr.h"
+
+/* include files. */
+#include "lpc17xx_i2c.h"
+#include "lpc17xx_timer.h"
+#include "vtUtilities.h"
+
+/* ************************************************ */
+// Private definitions
+#if (vtI2CSniffRingLen & (vtI2CSniffRingLen-1))
+vtI2CSniffRingLen must be a power of 2
+#endif
+#define vtI2CSniffRingMask (vtI2CSniffRingLen-1)
+
+// The sniffer task does nothing but hand out events, so it does not need much stack unless output uses printf()
+#define baseStack 2
+#if PRINTF_VERSION == 1
+#define sniffSTACK_SIZE		((baseStack+5)*configMINIMAL_STACK_SIZE)
+#else
+#define sniffSTACK_SIZE		(baseStack*configMINIMAL_STACK_SIZE)
+#endif
+
+static void vtI2CSniffIsr(void *arg);
+static portTASK_FUNCTION_PROTO( vI2CSniffTask, pvParameters );
+// End of private definitions
+/* ************************************************ */
+
+/* ************************************************ */
+// Public API Functions
+//
+int vtI2CSniffInit(vtI2CSniff *snf,uint8_t i2cDevNum,unsigned portBASE_TYPE taskPriority,vtI2CSniffOutput output,void *arg)
+{
+	portBASE_TYPE retval;
+	TIM_TIMERCFG_Type timerCfg;
+
+	snf->devNum = i2cDevNum;
+	snf->output = output;
+	snf->outputArg = arg;
+	snf->head = 0;
+	snf->tail = 0;
+	snf->lastTime = 0;
+	snf->dropped = 0;
+	snf->now = 0;
+	snf->started = 0;
+	snf->inTransaction = 0;
+	snf->seenStop = 0;
+	snf->stats.events = 0;
+	snf->stats.dropped = 0;
+	snf->stats.transactions = 0;
+	snf->stats.busyUs = 0;
+	snf->stats.totalUs = 0;
+	snf->stats.gapMinUs = 0xFFFFFFFF;
+	snf->stats.gapMaxUs = 0;
+	snf->stats.gapLastUs = 0;
+	switch (i2cDevNum) {
+		case 0: snf->devAddr = LPC_I2C0; break;
+		case 1: snf->devAddr = LPC_I2C1; break;
+		case 2: snf->devAddr = LPC_I2C2; break;
+		default: return(vtI2CErrInit);
+	}
+
+	// Create semaphore to communicate with interrupt handler
+	vSemaphoreCreateBinary(snf->binSemaphore);
+	if (snf->binSemaphore == NULL) {
+		return(vtI2CErrInit);
+	}
+	// Need to do an initial "take" on the semaphore to ensure that it is initially blocked
+	if (xSemaphoreTake(snf->binSemaphore,0) != pdTRUE) {
+		vQueueDelete(snf->binSemaphore);
+		return(vtI2CErrInit);
+	}
+
+	// TIMER2 counts microseconds and just runs (it is only read, so there is no match and no interrupt)
+	timerCfg.PrescaleOption = TIM_PRESCALE_USVAL;
+	timerCfg.PrescaleValue = 1;
+	TIM_Init(LPC_TIM2,TIM_TIMER_MODE,&timerCfg);
+	TIM_Cmd(LPC_TIM2,ENABLE);
+
+	if (vtI2CAttachIsr(i2cDevNum,vtI2CSniffIsr,(void *) snf) != vtI2CInitSuccess) {
+		vQueueDelete(snf->binSemaphore);
+		return(vtI2CErrInit);
+	}
+	// Interrupt on every byte with any address, and leave SCL alone (we must never hold up the bus)
+	I2C_MonitorModeConfig(snf->devAddr,I2C_MONITOR_CFG_MATCHALL,ENABLE);
+	I2C_MonitorModeConfig(snf->devAddr,I2C_MONITOR_CFG_SCL_OUTPUT,DISABLE);
+	I2C_MonitorModeCmd(snf->devAddr,ENABLE);
+
+	/* Start the task */
+	if ((retval = xTaskCreate( vI2CSniffTask, ( signed char * ) "I2CSnf", sniffSTACK_SIZE, (void *) snf, taskPriority, ( xTaskHandle * ) NULL )) != pdPASS) {
+		VT_HANDLE_FATAL_ERROR(retval);
+	}
+	return(vtI2CInitSuccess);
+}
+
+void vtI2CSniffGetStats(vtI2CSniff *snf,vtI2CSniffStats *stats)
+{
+	taskENTER_CRITICAL();
+	(*stats) = snf->stats;
+	stats->dropped = snf->dropped;
+	taskEXIT_CRITICAL();
+}
+// End of public API Functions
+/* ************************************************ */
+
+// Put one event into the ring (interrupt handler only -- the caller has checked that there is room)
+static __INLINE void vtI2CSniffPut(vtI2CSniff *snf,uint16_t ts,uint8_t kind,uint8_t data)
+{
+	vtI2CSniffEvent *ev;
+	uint16_t count = snf->head - snf->tail;
+
+	ev = &(snf->ring[snf->head & vtI2CSniffRingMask]);
+	ev->ts = ts;
+	ev->kind = kind;
+	ev->data = data;
+	snf->head++;
+	if (count+1 == vtI2CSniffRingLen/2) {
+		static signed portBASE_TYPE xHigherPriorityTaskWoken;
+		xHigherPriorityTaskWoken = pdFALSE;
+		xSemaphoreGiveFromISR(snf->binSemaphore,&xHigherPriorityTaskWoken);
+		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+	}
+}
+
+// i2c interrupt handler for monitor mode (see vtI2CAttachIsr())
+//   Without clock stretching, the next byte may start to come in right away, so this has to be short
+static void vtI2CSniffIsr(void *arg)
+{
+	vtI2CSniff *snf = (vtI2CSniff *) arg;
+	LPC_I2C_TypeDef *i2c = snf->devAddr;
+	uint32_t now = LPC_TIM2->TC;
+	uint32_t delta = now - snf->lastTime;
+	uint8_t data = (uint8_t) i2c->I2DATA_BUFFER;
+	uint8_t kind;
+
+	switch (i2c->I2STAT & I2C_STAT_CODE_BITMASK) {
+		case I2C_I2STAT_S_RX_SLAW_ACK:
+		case I2C_I2STAT_S_RX_ARB_LOST_M_SLA:
+		case I2C_I2STAT_S_RX_GENCALL_ACK:
+		case I2C_I2STAT_S_RX_ARB_LOST_M_GENCALL:
+		case I2C_I2STAT_S_TX_SLAR_ACK:
+		case I2C_I2STAT_S_TX_ARB_LOST_M_SLA: {
+			kind = vtI2CSniffAddr;
+			break;
+		}
+		case I2C_I2STAT_S_RX_PRE_SLA_DAT_ACK:
+		case I2C_I2STAT_S_RX_PRE_GENCALL_DAT_ACK:
+		case I2C_I2STAT_S_TX_DAT_ACK:
+		case I2C_I2STAT_S_TX_LAST_DAT_ACK: {
+			kind = vtI2CSniffData;
+			break;
+		}
+		case I2C_I2STAT_S_RX_PRE_SLA_DAT_NACK:
+		case I2C_I2STAT_S_RX_PRE_GENCALL_DAT_NACK:
+		case I2C_I2STAT_S_TX_DAT_NACK: {
+			kind = vtI2CSniffDataNack;
+			break;
+		}
+		case I2C_I2STAT_S_RX_STA_STO_SLVREC_SLVTRX: {
+			kind = vtI2CSniffStop;
+			data = 0;
+			break;
+		}
+		default: {
+			// nothing to record
+			i2c->I2CONSET = I2C_I2CONSET_AA;
+			i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+			return;
+		}
+	}
+	// The event and its time event go in together or not at all; if they are dropped, lastTime stays where it is so
+	//   that the time of the next event that does go in is still worked out from the latest one the task will see
+	if ((uint16_t) (snf->head - snf->tail) + ((delta > 0xFFFF) ? 2 : 1) > vtI2CSniffRingLen) {
+		snf->dropped++;
+	} else {
+		if (delta > 0xFFFF) {
+			vtI2CSniffPut(snf,(uint16_t) snf->lastTime,vtI2CSniffTime,(delta > 0xFFFFFF) ? 0xFF : (delta >> 16));
+		}
+		vtI2CSniffPut(snf,(uint16_t) now,kind,data);
+		snf->lastTime = now;
+	}
+	i2c->I2CONSET = I2C_I2CONSET_AA;
+	i2c->I2CONCLR = I2C_I2CONCLR_SIC;
+}
+
+// Keep track of the time and of the bus occupancy (sniffer task only)
+static void vtI2CSniffDecode(vtI2CSniff *snf,const vtI2CSniffEvent *ev,uint16_t count)
+{
+	uint32_t gap;
+	uint16_t i;
+
+	for (i=0;i<count;i++,ev++) {
+		if (ev->kind == vtI2CSniffTime) {
+			snf->now += ((uint32_t) ev->data) << 16;
+			continue;
+		}
+		// the low 16 bits of the time moved on by this much since the latest event
+		snf->now += (uint16_t) (ev->ts - (uint16_t) snf->now);
+		if (!snf->started) {
+			snf->started = 1;
+			snf->first = snf->now;
+		}
+		if (ev->kind == vtI2CSniffAddr) {
+			snf->stats.transactions++;
+			if (!snf->inTransaction) {
+				// there is no gap to measure before the first stop
+				if (snf->seenStop) {
+					gap = snf->now - snf->idleStart;
+					taskENTER_CRITICAL();
+					snf->stats.gapLastUs = gap;
+					if (gap < snf->stats.gapMinUs) snf->stats.gapMinUs = gap;
+					if (gap > snf->stats.gapMaxUs) snf->stats.gapMaxUs = gap;
+					taskEXIT_CRITICAL();
+				}
+				snf->inTransaction = 1;
+				snf->busyStart = snf->now;
+			}
+		} else if ((ev->kind == vtI2CSniffStop) && snf->inTransaction) {
+			taskENTER_CRITICAL();
+			snf->stats.busyUs += snf->now - snf->busyStart;
+			taskEXIT_CRITICAL();
+			snf->inTransaction = 0;
+			snf->seenStop = 1;
+			snf->idleStart = snf->now;
+		}
+	}
+	taskENTER_CRITICAL();
+	snf->stats.events += count;
+	snf->stats.totalUs = snf->now - snf->first;
+	taskEXIT_CRITICAL();
+}
+
+// This is the actual task that is run
+static portTASK_FUNCTION( vI2CSniffTask, pvParameters )
+{
+	vtI2CSniff *snf = (vtI2CSniff *) pvParameters;
+	uint16_t head, count;
+
+	for (;;) {
+		// Wait for the ring to get half full, or for the flush time to run out
+		xSemaphoreTake(snf->binSemaphore,vtI2CSniffFlushMs / portTICK_RATE_MS);
+		head = snf->head;
+		while (snf->tail != head) {
+			// hand out as much as can be done in one piece (up to the end of the ring)
+			count = head - snf->tail;
+			if (count > vtI2CSniffRingLen - (snf->tail & vtI2CSniffRingMask)) {
+				count = vtI2CSniffRingLen - (snf->tail & vtI2CSniffRingMask);
+			}
+			vtI2CSniffDecode(snf,&(snf->ring[snf->tail & vtI2CSniffRingMask]),count);
+			if (snf->output != NULL) {
+				snf->output(&(snf->ring[snf->tail & vtI2CSniffRingMask]),count,snf->outputArg);
+			}
+			// only now can the interrupt handler reuse these slots
+			snf->tail += count;
+		}
+	}
+}
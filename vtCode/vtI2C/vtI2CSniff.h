@@ -0,0 +1,90 @@
+#ifndef __vtI2CSniffh
+#define __vtI2CSniffh
+/* include files. */
+#include "lpc17xx_i2c.h"
+#include "vtI2C.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+// I2C bus sniffer
+//   A spare I2C peripheral, with its pins wired onto the bus to be watched, is put into monitor mode: it sees every
+//   address and data byte on the bus but never drives it (not even to stretch the clock).  The interrupt handler
+//   timestamps each byte and each stop/restart (with TIMER2, at 1us) and packs it into a 4 byte event in a ring; a task
+//   hands the events out in batches to an output function and keeps track of how busy the bus is.
+//
+// Number of events in the ring (a power of 2) -- the task is woken up early once it is half full
+#define vtI2CSniffRingLen 256
+// Longest time events sit in the ring before they are handed out
+#define vtI2CSniffFlushMs 100
+
+// Event kinds
+#define vtI2CSniffAddr 0		// Start (or restart) and the address byte (data is the address << 1 | R/W)
+#define vtI2CSniffData 1		// Data byte that was acknowledged
+#define vtI2CSniffDataNack 2	// Data byte that was not acknowledged (the end of a read)
+#define vtI2CSniffStop 3		// Stop (or the restart before the next vtI2CSniffAddr)
+#define vtI2CSniffTime 4		// Not a bus event: data is the number of times (up to 255) that ts wrapped since the last event
+
+// One event -- ts is the low 16 bits of a 1us clock; vtI2CSniffTime events are put in to take care of longer gaps
+typedef struct __vtI2CSniffEvent {
+	uint16_t ts;
+	uint8_t kind;
+	uint8_t data;
+} vtI2CSniffEvent;
+
+// Function called by the sniffer task with each batch of events (count events, in order, starting at ev)
+typedef void (*vtI2CSniffOutput)(const vtI2CSniffEvent *ev,uint16_t count,void *arg);
+
+// What the sniffer has seen so far (all times are in us)
+typedef struct __vtI2CSniffStats {
+	uint32_t events;		// Number of events handed out
+	uint32_t dropped;		// Number of events lost because the ring was full
+	uint32_t transactions;	// Number of address bytes seen
+	uint32_t busyUs;		// Time from the first address byte of a transaction to its stop, added up
+	uint32_t totalUs;		// Time since the first event (busyUs/totalUs is the bus occupancy)
+	uint32_t gapMinUs;		// Shortest, longest and latest time from a stop to the next address byte (the controller cannot
+							//   tell a restart from a stop, so the gap before a restart counts as well)
+	uint32_t gapMaxUs;
+	uint32_t gapLastUs;
+} vtI2CSniffStats;
+
+typedef struct __vtI2CSniff {
+	uint8_t devNum;							// Number of the I2C peripheral (0,1,2 on the 1768)
+	LPC_I2C_TypeDef *devAddr;				// Memory address of the I2C peripheral
+	vtI2CSniffOutput output;				// Where the batches of events go
+	void *outputArg;						// Passed to output as is
+	xSemaphoreHandle binSemaphore;			// Given by the interrupt handler when the ring is half full
+	// Ring of events from the interrupt handler to the task
+	//   Only the interrupt handler writes head and only the task writes tail
+	vtI2CSniffEvent ring[vtI2CSniffRingLen];
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	uint32_t lastTime;						// Time of the latest event (interrupt handler only)
+	volatile uint32_t dropped;
+	// Decoding of the events (task only)
+	uint32_t now;							// Time of the latest event handed out
+	uint32_t first, busyStart, idleStart;
+	uint8_t started, inTransaction, seenStop;
+	vtI2CSniffStats stats;
+} vtI2CSniff;
+
+/* ********************************************************************* */
+// The following are the public API calls to work with the sniffer
+
+// Args:
+//   snf: pointer to the vtI2CSniff data structure
+//   i2cDevNum: The number of the (spare) i2c device -- 0, 1, or 2 (see vtI2CInit() for the pins)
+//   taskPriority: At what priority should the sniffer task be run?
+//   output: function called with each batch of events
+//   arg: passed to output as is
+// Return:
+//   if successful, returns vtI2CInitSuccess
+//   if not, returns vtI2CErrInit
+// Uses TIMER2 for the timestamps
+int vtI2CSniffInit(vtI2CSniff *snf,uint8_t i2cDevNum,unsigned portBASE_TYPE taskPriority,vtI2CSniffOutput output,void *arg);
+
+// Get a copy of what the sniffer has seen so far
+// Args:
+//   snf: pointer to the vtI2CSniff data structure
+//   stats: filled in with the statistics
+void vtI2CSniffGetStats(vtI2CSniff *snf,vtI2CSniffStats *stats);
+#endif
@@ -189,13 +189,22 @@ int putchar(int c)
 	return VTputchar(c);
 }
 
-static void printchar(char **str, int c)
+// Where sprintf()/snprintf() put the characters: pos is where the next one goes, and nothing is put at or past end
+//   (NULL for no limit), which leaves room for the '\0'
+typedef struct {
+	char *pos;
+	char *end;
+} printOut;
+
+static void printchar(printOut *str, int c)
 {
 	//extern int putchar(int c);
 	
 	if (str) {
-		**str = (char)c;
-		++(*str);
+		if ((str->end == NULL) || (str->pos < str->end)) {
+			*(str->pos) = (char)c;
+			++(str->pos);
+		}
 	}
 	else
 	{ 
@@ -206,7 +215,7 @@ static void printchar(char **str, int c)
 #define PAD_RIGHT 1
 #define PAD_ZERO 2
 
-static int prints(char **out, const char *string, int width, int pad)
+static int prints(printOut *out, const char *string, int width, int pad)
 {
 	register int pc = 0, padchar = ' ';
 
@@ -239,7 +248,7 @@ static int prints(char **out, const char *string, int width, int pad)
 /* the following should be enough for 32 bit int */
 #define PRINT_BUF_LEN 12
 
-static int printi(char **out, int i, int b, int sg, int width, int pad, int letbase)
+static int printi(printOut *out, int i, int b, int sg, int width, int pad, int letbase)
 {
 	char print_buf[PRINT_BUF_LEN];
 	register char *s;
@@ -282,7 +291,7 @@ static int printi(char **out, int i, int b, int sg, int width, int pad, int letb
 	return pc + prints (out, s, width, pad);
 }
 
-static int print( char **out, const char *format, va_list args )
+static int print( printOut *out, const char *format, va_list args )
 {
 	register int width, pad;
 	register int pc = 0;
@@ -341,7 +350,7 @@ static int print( char **out, const char *format, va_list args )
 			++pc;
 		}
 	}
-	if (out) **out = '\0';
+	if (out) *(out->pos) = '\0';
 	va_end( args );
 	return pc;
 }
@@ -373,20 +382,26 @@ int (puts(const char *s)
 int sprintf(char *out, const char *format, ...)
 {
         va_list args;
+        printOut dst;
         
+        dst.pos = out;
+        dst.end = NULL;
         va_start( args, format );
-        return print( &out, format, args );
+        return print( &dst, format, args );
 }
 
 
+// At most count-1 characters are written, and then a '\0' -- the return value is the full length, as for sprintf()
 int snprintf( char *buf, unsigned int count, const char *format, ... )
 {
         va_list args;
+        printOut dst;
         
-        ( void ) count;
-        
+        if (count == 0) return 0;
+        dst.pos = buf;
+        dst.end = buf + count - 1;
         va_start( args, format );
-        return print( &buf, format, args );
+        return print( &dst, format, args );
 }
 #endif
 
@@ -23,6 +23,7 @@
 #define vtITMPortTempVals 5
 #define vtITMPortI2C1IntHandler 6
 #define vtITMPortLCDMsg 7 
+#define vtITMPortI2CSniff 8
 // #define vtITMPort??? 31
 // End of list of port definitions
 
@@ -147,6 +148,27 @@ Something is not right...
    Enf of Definition of printf()
    ************************************************************ */
 
+/* ************************************************************
+   Cycle counter
+   ************************************************************ */
+// The DWT unit of the Cortex-M3 counts CPU cycles, which is the easiest way to find out what a piece of code costs
+//   (at 100MHz the count wraps after about 43 seconds, so only use it for short stretches).
+// core_cm3.h does not describe the DWT, so the two registers used here are named directly.
+#define vtDWT_CTRL (*((volatile uint32_t *) 0xE0001000UL))
+#define vtDWT_CYCCNT (*((volatile uint32_t *) 0xE0001004UL))
+#define vtDWT_CTRL_CYCCNTENA (1UL)
+// Start the counter (the debugger may also have done this -- it does not hurt to do it again)
+static __INLINE void vtCycleCountInit(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	vtDWT_CTRL |= vtDWT_CTRL_CYCCNTENA;
+}
+// Read the counter -- subtract two readings (as uint32_t) to get the number of cycles in between
+#define vtCycleCount() (vtDWT_CYCCNT)
+/* ************************************************************
+   End of cycle counter
+   ************************************************************ */
+
 #define VT_HANDLE_FATAL_ERROR(code) vtHandleFatalError(code,__LINE__,__FILE__)
 void vtHandleFatalError(int,int,char []);
 